@@ -0,0 +1,287 @@
+#ifndef HANDLER_CLAIM_INDEX_HANDLER_H
+#define HANDLER_CLAIM_INDEX_HANDLER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../utils/hash.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// Maps claim_ids to dense integer ids, assigned in the order claims are read.
+// NOTE claim_ids are keyed on their 128-bit hash, so the index stores 24 bytes
+//      per claim instead of the (much longer) claim_id itself.
+// NOTE a single thread assigns ids while others may concurrently look them up.
+//      Lookups of claims that have not been read yet block until they are
+//      assigned, the claims of their entity are done (see end_entity) or the
+//      claims pass is done.
+class claim_index {
+public:
+  claim_index() : shards_(kShardCount) {}
+
+  auto assign(const std::string &claim_id) -> std::uint64_t {
+    const utils::hash128_t key = utils::hash128(claim_id);
+    shard &target = shard_for(key);
+    const std::uint64_t id = size_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::unique_lock lock(target.mutex);
+      target.insert(key, id);
+    }
+    if (waiting_.load() != 0) {
+      std::lock_guard lock(wait_mutex_);
+      if (std::ranges::any_of(
+              waits_, [&](const wait &entry) { return entry.key == key; })) {
+        assigned_.notify_all();
+      }
+    }
+    return id;
+  }
+
+  // NOTE called once all claims of entity_id (a tagged id) have been
+  //      assigned, i.e., lookups of its other claims miss immediately.
+  auto end_entity(std::uint64_t entity_id) -> void {
+    const auto [tag, number] = split(entity_id);
+    if (entity_id == kNoEntityId || number >= kMaxTrackedNumber) {
+      return;
+    }
+    std::lock_guard lock(wait_mutex_);
+    std::vector<bool> &done = done_entities_[tag];
+    if (number >= done.size()) {
+      done.resize(std::max<std::uint64_t>(2 * done.size(), number + 1));
+    }
+    done[number] = true;
+    if (std::ranges::any_of(waits_, [&](const wait &entry) {
+          return entry.entity_id == entity_id;
+        })) {
+      assigned_.notify_all();
+    }
+  }
+
+  // NOTE returns std::nullopt for claims that are not indexed.
+  auto lookup(const std::string &claim_id) -> std::optional<std::uint64_t> {
+    const utils::hash128_t key = utils::hash128(claim_id);
+    shard &target = shard_for(key);
+    if (auto id = find(target, key); id.has_value()) {
+      return id;
+    }
+    const std::uint64_t entity_id =
+        encode_entity_id(
+            std::string_view(claim_id).substr(0, claim_id.find('$')))
+            .value_or(kNoEntityId);
+    std::unique_lock lock(wait_mutex_);
+    ++waiting_;
+    waits_.push_back(wait{.key = key, .entity_id = entity_id});
+    std::optional<std::uint64_t> id;
+    assigned_.wait(lock, [&]() {
+      id = find(target, key);
+      return id.has_value() || is_done(entity_id) || done_;
+    });
+    waits_.erase(std::ranges::find_if(waits_, [&](const wait &entry) {
+      return entry.key == key && entry.entity_id == entity_id;
+    }));
+    --waiting_;
+    if (!id.has_value() && !done_) {
+      ++early_miss_count_;
+    }
+    return id;
+  }
+
+  // NOTE called once all claims have been assigned an id.
+  auto done() -> void {
+    std::lock_guard lock(wait_mutex_);
+    done_ = true;
+    assigned_.notify_all();
+  }
+
+  auto size() const -> std::uint64_t { return size_.load(); }
+
+  // NOTE the number of lookups that missed before the claims pass was done.
+  auto early_miss_count() const -> std::uint64_t {
+    return early_miss_count_.load();
+  }
+
+private:
+  static constexpr std::uint64_t kShardCount = 64;
+  static constexpr std::uint64_t kInitialCapacity = 1024;
+  // NOTE entities with larger numbers are not tracked, i.e., lookups of
+  //      their claims wait for the claims pass to be done.
+  static constexpr std::uint64_t kMaxTrackedNumber = std::uint64_t(1) << 32;
+
+  // A pending lookup, i.e., the claim and its entity that it waits for.
+  struct wait {
+    utils::hash128_t key;
+    std::uint64_t entity_id;
+  };
+
+  // Open addressing with linear probing.
+  // NOTE a slot is empty if id_plus_one is zero.
+  struct shard {
+    struct slot {
+      utils::hash128_t key;
+      std::uint64_t id_plus_one = 0;
+    };
+
+    auto find(const utils::hash128_t &key) const
+        -> std::optional<std::uint64_t> {
+      if (slots.empty()) {
+        return std::nullopt;
+      }
+      const std::uint64_t mask = slots.size() - 1;
+      for (std::uint64_t index = key.lo & mask;; index = (index + 1) & mask) {
+        const slot &entry = slots[index];
+        if (entry.id_plus_one == 0) {
+          return std::nullopt;
+        }
+        if (entry.key == key) {
+          return entry.id_plus_one - 1;
+        }
+      }
+    }
+
+    auto insert(const utils::hash128_t &key, std::uint64_t id) -> void {
+      if (10 * (size + 1) > 7 * slots.size()) {
+        grow();
+      }
+      place(slots, key, id + 1);
+      ++size;
+    }
+
+    auto grow() -> void {
+      std::vector<slot> grown(
+          std::max(kInitialCapacity, 2 * (std::uint64_t)slots.size()));
+      for (const slot &entry : slots) {
+        if (entry.id_plus_one != 0) {
+          place(grown, entry.key, entry.id_plus_one);
+        }
+      }
+      slots.swap(grown);
+    }
+
+    static auto place(std::vector<slot> &slots, const utils::hash128_t &key,
+                      std::uint64_t id_plus_one) -> void {
+      const std::uint64_t mask = slots.size() - 1;
+      std::uint64_t index = key.lo & mask;
+      while (slots[index].id_plus_one != 0 && !(slots[index].key == key)) {
+        index = (index + 1) & mask;
+      }
+      slots[index] = slot{.key = key, .id_plus_one = id_plus_one};
+    }
+
+    mutable std::shared_mutex mutex;
+    std::vector<slot> slots;
+    std::uint64_t size = 0;
+  };
+
+  auto shard_for(const utils::hash128_t &key) -> shard & {
+    return shards_[key.hi % kShardCount];
+  }
+
+  static auto find(const shard &target, const utils::hash128_t &key)
+      -> std::optional<std::uint64_t> {
+    std::shared_lock lock(target.mutex);
+    return target.find(key);
+  }
+
+  // NOTE splits a tagged id into its prefix character and number.
+  static auto split(std::uint64_t entity_id)
+      -> std::pair<std::uint8_t, std::uint64_t> {
+    return {static_cast<std::uint8_t>(entity_id >> 56),
+            entity_id & kEntityNumberMask};
+  }
+
+  // NOTE requires holding wait_mutex_.
+  auto is_done(std::uint64_t entity_id) const -> bool {
+    if (entity_id == kNoEntityId) {
+      return false;
+    }
+    const auto [tag, number] = split(entity_id);
+    const std::vector<bool> &done = done_entities_[tag];
+    return number < done.size() && done[number];
+  }
+
+  std::vector<shard> shards_;
+  std::atomic<std::uint64_t> size_ = 0;
+
+  std::mutex wait_mutex_;
+  std::condition_variable assigned_;
+  std::atomic<std::uint64_t> waiting_ = 0;
+  std::vector<wait> waits_;
+  // NOTE one bit per entity number, indexed by the prefix character.
+  std::array<std::vector<bool>, 256> done_entities_;
+  std::atomic<std::uint64_t> early_miss_count_ = 0;
+  bool done_ = false;
+};
+
+// Marks the entities of the claims as done in the claim_index once all of
+// their rows have been handled, so lookups of their claims that have no id
+// (e.g., filtered by rank) miss without waiting for the whole claims pass.
+// NOTE ids are assigned as the claims are written (see claim_id_encoder),
+//      i.e., this handler must be stacked after the claims output.
+struct claim_index_handler : public empty_handler</*fail_if_unhandled=*/false> {
+public:
+  using used_columns = detail::wd_column_set<detail::kEntityId>;
+
+  // NOTE no entities are marked if index is nullptr.
+  claim_index_handler(claim_index *index) : index_(index) {}
+
+  auto summary() -> void {
+    if (index_ != nullptr) {
+      std::cout << "# indexed claims: " << index_->size() << std::endl;
+      std::cout << "# lookups missed before the end of the claims: "
+                << index_->early_miss_count() << std::endl;
+    }
+  }
+
+  // NOTE the rows before an entity end belong to that entity, an end at the
+  //      start of the block ends the last entity of the previous block.
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    if (index_ == nullptr) {
+      return;
+    }
+    for (const std::uint32_t end : block.entity_ends()) {
+      if (end != 0) {
+        entity_id_ = entity_of(block.columns(end - 1));
+      }
+      index_->end_entity(entity_id_);
+    }
+    if (block.size() != 0) {
+      entity_id_ = entity_of(block.columns(block.size() - 1));
+    }
+  }
+
+  auto end_entity() -> void {
+    if (index_ != nullptr) {
+      index_->end_entity(entity_id_);
+    }
+  }
+
+public: // result handlers
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) -> void {
+    entity_id_ = entity_of(columns);
+  }
+
+private:
+  template <typename columns_type>
+  static auto entity_of(const columns_type &columns) -> std::uint64_t {
+    return columns.template get_field<detail::kEntityId>().id();
+  }
+
+  claim_index *index_;
+  std::uint64_t entity_id_ = kNoEntityId;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_CLAIM_INDEX_HANDLER_H
@@ -1,27 +1,49 @@
 #ifndef HANDLER_CSV_HANDLER_H
 #define HANDLER_CSV_HANDLER_H
 
+#include "../utils/bounded_cache.h"
+#include "../utils/external_sort.h"
+#include "../utils/offset_index.h"
+#include "claim_index_handler.h"
 #include "wikidata_handler.h"
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <exception>
+#include <filesystem>
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <string_view>
+#include <thread>
 
 namespace wd_migrate {
 namespace detail {
 // TODO(jlscheerer) This design requires an explicit check for datatype.
 //                  This is because we would otherwise join with the
 //                  calendermodel.
+// NOTE the fields are views of the columns and the value of the row, i.e.,
+//      staging a row for output does not allocate. A row must be written
+//      before the next one is handled. Id columns are rendered on output.
+// NOTE with integer times (see time_format), every row has two more columns,
+//      the precision and calendar model code of time values.
 struct claims_csv_output_row {
-  std::string entity_id, claim_id, property, datavalue_datatype,
-      datavalue_string, datavalue_entity_id, datavalue_time, datavalue_numeric;
+  using used_columns =
+      wd_column_set<kEntityId, kClaimId, kPropety, kDatavalueType>;
+
+  const wd_id_column *entity_id, *property;
+  std::string_view claim_id, datavalue_datatype, datavalue_string,
+      datavalue_entity_id, datavalue_time, datavalue_numeric,
+      datavalue_precision, datavalue_calendar;
+  bool integer_time = false;
 
   template <typename columns_type>
   static auto prepare_row(const columns_type &columns)
       -> claims_csv_output_row {
     claims_csv_output_row row;
-    row.entity_id = columns.template get_field<detail::kEntityId>();
-    row.claim_id = columns.template get_field<detail::kClaimId>();
-    row.property = columns.template get_field<detail::kPropety>();
+    row.entity_id = &columns.template get_field<detail::kEntityId>();
+    row.property = &columns.template get_field<detail::kPropety>();
     row.datavalue_datatype =
         columns.template get_field<detail::kDatavalueType>();
     return row;
@@ -30,24 +52,33 @@ struct claims_csv_output_row {
 
 template <typename ostream>
 auto operator<<(ostream &os, const claims_csv_output_row &row) -> ostream & {
-  os << row.entity_id << '\t' << row.claim_id << '\t' << row.property << '\t'
+  os << *row.entity_id << '\t' << row.claim_id << '\t' << *row.property << '\t'
      << row.datavalue_datatype << '\t' << row.datavalue_string << '\t'
      << row.datavalue_entity_id << '\t' << row.datavalue_time << '\t'
-     << row.datavalue_numeric << '\n';
+     << row.datavalue_numeric;
+  if (row.integer_time) {
+    os << '\t' << row.datavalue_precision << '\t' << row.datavalue_calendar;
+  }
+  os << '\n';
   return os;
 }
 
 struct qualifiers_csv_output_row {
-  std::string claim_id, qualifier_property, datavalue_datatype,
-      datavalue_string, datavalue_entity_id, datavalue_time, datavalue_numeric;
+  using used_columns =
+      wd_column_set<kClaimId, kQualifierProperty, kDatavalueType>;
+
+  const wd_id_column *qualifier_property;
+  std::string_view claim_id, datavalue_datatype, datavalue_string,
+      datavalue_entity_id, datavalue_time, datavalue_numeric,
+      datavalue_precision, datavalue_calendar;
+  bool integer_time = false;
 
   template <typename columns_type>
   static auto prepare_row(const columns_type &columns)
       -> qualifiers_csv_output_row {
     qualifiers_csv_output_row row;
-    row.claim_id = columns.template get_field<detail::kClaimId>();
     row.qualifier_property =
-        columns.template get_field<detail::kQualifierProperty>();
+        &columns.template get_field<detail::kQualifierProperty>();
     row.datavalue_datatype =
         columns.template get_field<detail::kDatavalueType>();
     return row;
@@ -57,13 +88,31 @@ struct qualifiers_csv_output_row {
 template <typename ostream>
 auto operator<<(ostream &os, const qualifiers_csv_output_row &row)
     -> ostream & {
-  os << row.claim_id << '\t' << row.qualifier_property << '\t'
+  os << row.claim_id << '\t' << *row.qualifier_property << '\t'
      << row.datavalue_datatype << '\t' << row.datavalue_string << '\t'
      << row.datavalue_entity_id << '\t' << row.datavalue_time << '\t'
-     << row.datavalue_numeric << '\n';
+     << row.datavalue_numeric;
+  if (row.integer_time) {
+    os << '\t' << row.datavalue_precision << '\t' << row.datavalue_calendar;
+  }
+  os << '\n';
   return os;
 }
 
+// Appends formatted rows to a string, e.g., to hand them to a sorter.
+struct line_buffer {
+  auto operator<<(std::string_view value) -> line_buffer & {
+    data.append(value);
+    return *this;
+  }
+  auto operator<<(char value) -> line_buffer & {
+    data.push_back(value);
+    return *this;
+  }
+
+  std::string data;
+};
+
 template <typename tag> struct csv_output_row {};
 template <> struct csv_output_row<claims_tag_t> {
   using type = claims_csv_output_row;
@@ -75,16 +124,186 @@ template <typename tag>
 using csv_output_row_t = typename csv_output_row<tag>::type;
 } // namespace detail
 
+enum class claim_id_format {
+  // The original claim_id, e.g., Q42$F078E5B3-F9A8-480E-B7AC-D97778CBBEF9.
+  text,
+  // The hex form of the decoded claim key (see claim_key_to_hex).
+  // NOTE claim_ids that are not of the canonical form are kept as text.
+  compact
+};
+
+// Encodes the claim_id of the rows emitted by csv_handler.
+struct claim_id_encoder {
+  claim_id_format format = claim_id_format::text;
+
+  // NOTE if set, claim_ids are replaced by their id in the index instead.
+  claim_index *index = nullptr;
+  // NOTE if set, the claims are assigned the next id in the index as they
+  //      are written (instead of looking it up), i.e., only claims that are
+  //      part of the output have an id.
+  bool assign_ids = false;
+
+  // NOTE returns false if the row should be dropped.
+  auto encode(const wd_claim_id_t &claim_id, std::string &output) const
+      -> bool {
+    if (index != nullptr && assign_ids) {
+      output = std::to_string(index->assign(claim_id.value));
+    } else if (index != nullptr) {
+      const std::optional<std::uint64_t> id = index->lookup(claim_id.value);
+      if (!id.has_value()) {
+        return false;
+      }
+      output = std::to_string(*id);
+    } else if (format == claim_id_format::compact && claim_id.key.has_value()) {
+      output.clear();
+      append_claim_key_hex(output, *claim_id.key);
+    } else {
+      output = claim_id.value;
+    }
+    return true;
+  }
+};
+
+enum class time_format {
+  // The formatted timestamp, e.g., 2000-01-01T00:00:00+0000.
+  text,
+  // Signed microseconds since the Unix epoch, followed by the precision and
+  // the calendar model code (see wd_calendar_model) in two more columns.
+  // NOTE unlike text, timestamps outside the range of postgres are kept.
+  epoch_micros,
+  // Signed seconds since the Unix epoch, see epoch_micros.
+  epoch_seconds
+};
+
+enum class csv_sort_order {
+  // Rows are written in input order, i.e., grouped by entity_id.
+  none,
+  // Rows are sorted by (entity_id, property).
+  subject,
+  // Entity-valued rows are sorted by (datavalue_entity_id, entity_id), i.e.,
+  // the reverse edge list. All other rows are dropped.
+  object
+};
+
+// NOTE sorting is only supported for claims.
+struct csv_sort_options {
+  csv_sort_order order = csv_sort_order::none;
+
+  // NOTE sorted runs are spilled to <temp_prefix>.run<N>, defaults to the
+  //      output filename.
+  std::string temp_prefix;
+  std::uint64_t memory_budget = std::uint64_t(1) << 30;
+  unsigned thread_count = std::thread::hardware_concurrency();
+};
+
 template <typename tag, bool psql = true>
 struct csv_handler : public skip_novalue_handler {
   using csv_output_row = detail::csv_output_row_t<tag>;
 
 public:
-  csv_handler(const std::string &filename) { output_.open(filename); }
+  using used_columns = typename csv_output_row::used_columns;
+
+  // NOTE if index_filename is set, a sidecar index of the byte offset of every
+  //      entity is written (see utils/offset_index.h). For claims sorted by
+  //      object, the index is keyed on the datavalue_entity_id instead.
+  // NOTE if resume is set, the output is not truncated until the checkpoint
+  //      is loaded (see load_checkpoint).
+  csv_handler(const std::string &filename, claim_id_encoder encoder = {},
+              time_format time = time_format::text,
+              const csv_sort_options &sort = {},
+              const std::string &index_filename = {}, bool resume = false)
+      : filename_(filename), encoder_(encoder), time_format_(time),
+        sort_order_(sort.order), index_filename_(index_filename) {
+    static_assert(std::is_same_v<tag, claims_tag_t> ||
+                  std::is_same_v<tag, qualifiers_tag_t>);
+    file_ = std::make_unique<std::ofstream>(
+        filename, resume ? std::ios::app : std::ios::trunc);
+    output_ = file_.get();
+    if (sort_order_ != csv_sort_order::none) {
+      sorter_.emplace(sort.temp_prefix.empty() ? filename : sort.temp_prefix,
+                      sort.memory_budget, sort.thread_count);
+    }
+    if (!index_filename_.empty()) {
+      index_.emplace();
+    }
+  }
+
+  // NOTE writes the (unsorted, unindexed) rows to output instead of a file.
+  csv_handler(std::ostream &output, claim_id_encoder encoder = {},
+              time_format time = time_format::text)
+      : output_(&output), encoder_(encoder), time_format_(time),
+        sort_order_(csv_sort_order::none) {}
 
   auto summary() -> void {
-    output_.flush();
-    output_.close();
+    if (sorter_.has_value()) {
+      sorter_->finish(*output_, [&](const utils::sort_key_t &key,
+                                   const std::string &line) {
+        if (index_.has_value()) {
+          index_row(key.hi, line.size());
+        }
+      });
+    }
+    if (index_.has_value()) {
+      flush_run();
+      index_->write(index_filename_);
+      std::cout << "offset index: " << index_->size() << " entries"
+                << std::endl;
+    }
+    if (time_format_ == time_format::text) {
+      time_format_cache_.summary("time format");
+    }
+    if (encoder_.index != nullptr) {
+      std::cout << "rows with unknown claim_id: " << unknown_claim_count_
+                << std::endl;
+    }
+    output_->flush();
+    if (file_ != nullptr) {
+      file_->close();
+    }
+  }
+
+  // NOTE the sorter spills runs to disk, so sorted outputs are not supported.
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    if (sorter_.has_value() || file_ == nullptr) {
+      std::cerr << "Checkpoints require an unsorted output file" << std::endl;
+      std::exit(-1);
+    }
+    file_->flush();
+    writer.write(
+        static_cast<std::uint64_t>(std::filesystem::file_size(filename_)));
+    writer.write(unknown_claim_count_);
+    writer.write(index_.has_value());
+    if (index_.has_value()) {
+      index_->save_checkpoint(writer);
+      writer.write(bytes_written_);
+      writer.write(run_entity_id_);
+      writer.write(run_offset_);
+      writer.write(run_rows_);
+    }
+  }
+
+  // NOTE truncates the output to its size at the checkpoint.
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    std::uint64_t size;
+    reader.read(size);
+    file_->close();
+    std::filesystem::resize_file(filename_, size);
+    file_->open(filename_, std::ios::app);
+    reader.read(unknown_claim_count_);
+    bool has_index;
+    reader.read(has_index);
+    if (has_index != index_.has_value()) {
+      std::cerr << "Checkpoint does not match the --index option"
+                << std::endl;
+      std::exit(-1);
+    }
+    if (index_.has_value()) {
+      index_->load_checkpoint(reader);
+      reader.read(bytes_written_);
+      reader.read(run_entity_id_);
+      reader.read(run_offset_);
+      reader.read(run_rows_);
+    }
   }
 
 public: // result handlers
@@ -92,7 +311,7 @@ public: // result handlers
   auto handle(const columns_type &columns, const wd_string_t &value) -> void {
     csv_output_row row = csv_output_row::prepare_row(columns);
     row.datavalue_string = value.value;
-    output_ << row;
+    write_row(columns, row);
   }
 
   template <typename columns_type>
@@ -100,7 +319,7 @@ public: // result handlers
       -> void {
     csv_output_row row = csv_output_row::prepare_row(columns);
     row.datavalue_entity_id = value.value;
-    output_ << row;
+    write_row(columns, row, /*is_edge=*/true);
   }
 
   template <typename columns_type>
@@ -110,28 +329,24 @@ public: // result handlers
     }
     csv_output_row row = csv_output_row::prepare_row(columns);
     row.datavalue_string = value.text;
-    output_ << row;
+    write_row(columns, row);
   }
 
   template <typename columns_type>
   auto handle(const columns_type &columns, const wd_time_t &value) -> void {
-    if constexpr (psql) {
-      if (value.get_year() <= -4713 || value.get_year() >= 294276) {
-        return; // NOTE postgres does not support timestamp not within this
-                // range. See
-                // https://www.postgresql.org/docs/current/datatype-datetime.html.
+    csv_output_row row = csv_output_row::prepare_row(columns);
+    if (time_format_ == time_format::text) {
+      const std::string &time = time_format_cache_.get_or_insert(
+          value.time, [&]() { return format_time(value); });
+      if (time.empty()) {
+        return;
       }
-      csv_output_row row = csv_output_row::prepare_row(columns);
-      // NOTE requires setting "set time zone UTC;" in psql
-      row.datavalue_time = value.psql_str();
-      row.datavalue_entity_id = value.calendermodel;
-      output_ << row;
+      row.datavalue_time = time;
     } else {
-      csv_output_row row = csv_output_row::prepare_row(columns);
-      row.datavalue_time = value.ustr();
-      row.datavalue_entity_id = value.calendermodel;
-      output_ << row;
+      encode_time(value, row);
     }
+    row.datavalue_entity_id = value.calendermodel;
+    write_row(columns, row);
   }
 
   template <typename columns_type>
@@ -141,7 +356,7 @@ public: // result handlers
     if (value.unit.has_value()) {
       row.datavalue_entity_id = *value.unit;
     }
-    output_ << row;
+    write_row(columns, row);
   }
 
   template <typename columns_type>
@@ -154,7 +369,146 @@ public: // result handlers
   using skip_novalue_handler::handle;
 
 private:
-  std::ofstream output_;
+  template <typename columns_type>
+  auto write_row(const columns_type &columns, csv_output_row &row,
+                 bool is_edge = false) -> void {
+    // NOTE dropped before encoding, so that no claim id is assigned.
+    if (sort_order_ == csv_sort_order::object && !is_edge) {
+      return;
+    }
+    if (!encoder_.encode(columns.template get_field<detail::kClaimId>(),
+                         claim_id_)) {
+      ++unknown_claim_count_;
+      return;
+    }
+    row.claim_id = claim_id_;
+    row.integer_time = (time_format_ != time_format::text);
+    if constexpr (std::is_same_v<tag, claims_tag_t>) {
+      if (sorter_.has_value()) {
+        line_.data.clear();
+        line_ << row;
+        sorter_->add(sort_key(row), line_.data);
+        return;
+      }
+      if (index_.has_value()) {
+        line_.data.clear();
+        line_ << row;
+        index_row(entity_key(*row.entity_id), line_.data.size());
+        *output_ << line_.data;
+        return;
+      }
+    }
+    *output_ << row;
+  }
+
+  // NOTE rows are grouped by entity, so a run of rows ends once the entity
+  //      changes.
+  auto index_row(std::uint64_t entity_id, std::uint64_t size) -> void {
+    if (run_rows_ != 0 && entity_id != run_entity_id_) {
+      flush_run();
+    }
+    if (run_rows_ == 0) {
+      run_entity_id_ = entity_id;
+      run_offset_ = bytes_written_;
+    }
+    ++run_rows_;
+    bytes_written_ += size;
+  }
+
+  auto flush_run() -> void {
+    if (run_rows_ != 0 && run_entity_id_ != kUnknownEntity) {
+      index_->add(run_entity_id_, run_offset_, run_rows_);
+    }
+    run_rows_ = 0;
+  }
+
+  static constexpr std::uint64_t kUnknownEntity = ~std::uint64_t(0);
+
+  static auto entity_key(const detail::wd_id_column &column)
+      -> std::uint64_t {
+    return column.id() != kNoEntityId ? column.id() : kUnknownEntity;
+  }
+
+  // NOTE ids that are not of the form Q42 are sorted last.
+  auto sort_key(const detail::claims_csv_output_row &row) const
+      -> utils::sort_key_t {
+    if (sort_order_ == csv_sort_order::object) {
+      return {.hi = encode_entity_id(row.datavalue_entity_id)
+                        .value_or(kUnknownEntity),
+              .lo = entity_key(*row.entity_id)};
+    }
+    return {.hi = entity_key(*row.entity_id),
+            .lo = entity_key(*row.property)};
+  }
+
+  // NOTE returns an empty string for timestamps that cannot be represented.
+  static auto format_time(const wd_time_t &value) -> std::string {
+    if constexpr (psql) {
+      if (value.get_year() <= -4713 || value.get_year() >= 294276) {
+        return ""; // NOTE postgres does not support timestamp not within this
+                   // range. See
+                   // https://www.postgresql.org/docs/current/datatype-datetime.html.
+      }
+      // NOTE requires setting "set time zone UTC;" in psql
+      return value.psql_str();
+    } else {
+      return value.ustr();
+    }
+  }
+
+  // NOTE iso8601 has millisecond resolution and at most four year digits,
+  //      so the epoch microseconds cannot overflow.
+  auto encode_time(const wd_time_t &value, csv_output_row &row) -> void {
+    const std::int64_t epoch =
+        time_format_ == time_format::epoch_micros
+            ? std::chrono::duration_cast<std::chrono::microseconds>(
+                  value.iso8601.time_since_epoch())
+                  .count()
+            : std::chrono::floor<std::chrono::seconds>(value.iso8601)
+                  .time_since_epoch()
+                  .count();
+    row.datavalue_time = format_integer(epoch, epoch_);
+    row.datavalue_precision = format_integer(value.precision, precision_);
+    row.datavalue_calendar = format_integer(
+        detail::wd_calendar_model::code_of(value.calendermodel), calendar_);
+  }
+
+  using integer_buffer = std::array<char, 20>;
+
+  template <typename integer>
+  static auto format_integer(integer value, integer_buffer &buffer)
+      -> std::string_view {
+    const auto [end, error] =
+        std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    return std::string_view(buffer.data(), end - buffer.data());
+  }
+
+  // NOTE the file is owned behind a pointer, so output_ stays valid when the
+  //      handler is moved.
+  std::string filename_;
+  std::unique_ptr<std::ofstream> file_;
+  std::ostream *output_;
+  const claim_id_encoder encoder_;
+  const time_format time_format_;
+
+  const csv_sort_order sort_order_;
+  std::optional<utils::external_sorter> sorter_;
+  detail::line_buffer line_;
+
+  const std::string index_filename_;
+  std::optional<utils::offset_index_writer> index_;
+  std::uint64_t bytes_written_ = 0;
+  std::uint64_t run_entity_id_ = 0, run_offset_ = 0, run_rows_ = 0;
+
+  std::uint64_t unknown_claim_count_ = 0;
+  // NOTE the encoded claim_id of the row being written, reused across rows.
+  std::string claim_id_;
+
+  // NOTE the integer columns of the time being written, reused across rows.
+  integer_buffer epoch_, precision_, calendar_;
+
+  // NOTE the formatted time only depends on the raw time string.
+  utils::bounded_cache<std::string, (1 << 14)> time_format_cache_;
 };
 } // namespace wd_migrate
 
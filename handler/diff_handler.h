@@ -0,0 +1,252 @@
+#ifndef HANDLER_DIFF_HANDLER_H
+#define HANDLER_DIFF_HANDLER_H
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "../utils/bounded_queue.h"
+#include "../utils/hash.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// The formatted output rows of a single entity.
+struct entity_group {
+  std::string entity_id;
+  utils::hash128_t hash;
+  std::string rows;
+};
+
+// Collects the rows written to rows (e.g., by a csv_handler earlier in the
+// stack) into one entity_group per entity and hands them to groups.
+// NOTE needs to directly follow the handler writing to rows, so that both
+//      see the rows in lockstep (i.e., neither handles a block as a whole)
+//      and buffering handlers have flushed the entity into rows before
+//      end_entity() is called.
+// NOTE entities without any output rows are skipped.
+struct entity_group_handler
+    : public empty_handler</*fail_if_unhandled=*/false> {
+public:
+  using used_columns = detail::wd_column_set<detail::kEntityId>;
+
+  entity_group_handler(std::ostringstream &rows,
+                       utils::bounded_queue<entity_group> &groups)
+      : rows_(&rows), groups_(&groups) {}
+
+  auto summary() -> void {
+    std::cout << "entities with output rows: " << group_count_ << std::endl;
+  }
+
+public: // result handlers
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) -> void {
+    entity_id_ = columns.template get_field<detail::kEntityId>();
+  }
+
+  auto end_entity() -> void {
+    std::string rows = rows_->str();
+    if (!rows.empty()) {
+      const utils::hash128_t hash = utils::hash128(rows);
+      groups_->push(entity_group{.entity_id = entity_id_.str(),
+                                 .hash = hash,
+                                 .rows = std::move(rows)});
+      ++group_count_;
+    }
+    rows_->str(std::string());
+  }
+
+private:
+  std::ostringstream *rows_;
+  utils::bounded_queue<entity_group> *groups_;
+  detail::wd_id_column entity_id_;
+  std::uint64_t group_count_ = 0;
+};
+
+// Compares the entity groups of an old and a new conversion and writes the
+// rows to delete and to insert to get from old to new.
+// NOTE entities are matched by id. Both inputs are expected to list common
+//      entities in the same order, so once an entity is matched, all
+//      unmatched entities read before it (on either side) are final, i.e.,
+//      at most the entities between two matches are buffered. Inputs in
+//      different orders still yield a correct (but larger) delta.
+class entity_group_diff {
+public:
+  entity_group_diff(const std::string &deleted_filename,
+                    const std::string &inserted_filename)
+      : deleted_(deleted_filename), inserted_(inserted_filename) {}
+
+  auto run(utils::bounded_queue<entity_group> &old_groups,
+           utils::bounded_queue<entity_group> &new_groups) -> void {
+    bool old_done = false, new_done = false;
+    while (!old_done || !new_done) {
+      if (!old_done) {
+        std::optional<entity_group> group = old_groups.pop();
+        old_done = !group.has_value();
+        if (group.has_value()) {
+          add(std::move(*group), old_, new_, /*is_old=*/true, new_done);
+        }
+      }
+      if (!new_done) {
+        std::optional<entity_group> group = new_groups.pop();
+        new_done = !group.has_value();
+        if (group.has_value()) {
+          add(std::move(*group), new_, old_, /*is_old=*/false, old_done);
+        }
+      }
+    }
+    flush(old_, deleted_, deleted_entities_, deleted_rows_);
+    flush(new_, inserted_, inserted_entities_, inserted_rows_);
+  }
+
+  auto summary() -> void {
+    std::cout << "entities: " << unchanged_entities_ << " unchanged, "
+              << changed_entities_ << " changed, " << inserted_entities_
+              << " inserted, " << deleted_entities_ << " deleted"
+              << std::endl;
+    std::cout << "rows: " << inserted_rows_ << " inserted, " << deleted_rows_
+              << " deleted" << std::endl;
+    deleted_.close();
+    inserted_.close();
+  }
+
+private:
+  // Unmatched groups of one side, in input order.
+  struct pending_groups {
+    std::deque<entity_group> groups;
+    // NOTE groups that have been matched are left empty in the deque.
+    std::unordered_map<std::string, std::uint64_t> positions;
+    std::uint64_t first_position = 0;
+  };
+
+  // NOTE once the other side is done, unmatched groups are final.
+  auto add(entity_group &&group, pending_groups &side, pending_groups &other,
+           bool is_old, bool other_done) -> void {
+    const auto it = other.positions.find(group.entity_id);
+    if (it == other.positions.end()) {
+      if (other_done) {
+        write_group(group, is_old ? deleted_ : inserted_,
+                    is_old ? deleted_entities_ : inserted_entities_,
+                    is_old ? deleted_rows_ : inserted_rows_);
+        return;
+      }
+      side.positions.emplace(group.entity_id,
+                             side.first_position + side.groups.size());
+      side.groups.push_back(std::move(group));
+      return;
+    }
+    const std::uint64_t position = it->second;
+    other.positions.erase(it);
+    entity_group &match = other.groups[position - other.first_position];
+    const entity_group &old_group = is_old ? group : match;
+    const entity_group &new_group = is_old ? match : group;
+    if (old_group.hash == new_group.hash) {
+      ++unchanged_entities_;
+    } else {
+      ++changed_entities_;
+      diff_rows(old_group.rows, new_group.rows);
+    }
+    match.entity_id.clear();
+    match.rows.clear();
+
+    // NOTE everything pending on this side was read before the match, as was
+    //      everything on the other side up to it.
+    std::ofstream &side_output = is_old ? deleted_ : inserted_;
+    std::ofstream &other_output = is_old ? inserted_ : deleted_;
+    std::uint64_t &side_entities =
+        is_old ? deleted_entities_ : inserted_entities_;
+    std::uint64_t &other_entities =
+        is_old ? inserted_entities_ : deleted_entities_;
+    std::uint64_t &side_rows = is_old ? deleted_rows_ : inserted_rows_;
+    std::uint64_t &other_rows = is_old ? inserted_rows_ : deleted_rows_;
+    flush(side, side_output, side_entities, side_rows);
+    flush_until(other, position + 1, other_output, other_entities,
+                other_rows);
+  }
+
+  auto flush(pending_groups &side, std::ofstream &output,
+             std::uint64_t &entities, std::uint64_t &rows) -> void {
+    flush_until(side, side.first_position + side.groups.size(), output,
+                entities, rows);
+  }
+
+  // NOTE writes (and drops) the pending groups before position.
+  auto flush_until(pending_groups &side, std::uint64_t position,
+                   std::ofstream &output, std::uint64_t &entities,
+                   std::uint64_t &rows) -> void {
+    for (; side.first_position < position; ++side.first_position) {
+      entity_group &group = side.groups.front();
+      if (!group.entity_id.empty()) {
+        side.positions.erase(group.entity_id);
+        write_group(group, output, entities, rows);
+      }
+      side.groups.pop_front();
+    }
+  }
+
+  static auto write_group(const entity_group &group, std::ofstream &output,
+                          std::uint64_t &entities, std::uint64_t &rows)
+      -> void {
+    output << group.rows;
+    ++entities;
+    rows += count_rows(group.rows);
+  }
+
+  // NOTE rows present in both entities are skipped, i.e., a changed claim
+  //      is deleted and inserted again.
+  auto diff_rows(const std::string &old_rows, const std::string &new_rows)
+      -> void {
+    std::unordered_map<std::string_view, std::uint64_t> counts;
+    for_each_row(old_rows, [&](std::string_view row) { ++counts[row]; });
+    for_each_row(new_rows, [&](std::string_view row) {
+      auto it = counts.find(row);
+      if (it != counts.end() && it->second != 0) {
+        --it->second;
+      } else {
+        inserted_ << row;
+        ++inserted_rows_;
+      }
+    });
+    for_each_row(old_rows, [&](std::string_view row) {
+      auto it = counts.find(row);
+      if (it->second != 0) {
+        --it->second;
+        deleted_ << row;
+        ++deleted_rows_;
+      }
+    });
+  }
+
+  // NOTE rows include their trailing newline.
+  template <typename row_fn>
+  static auto for_each_row(const std::string_view rows, row_fn &&fn) -> void {
+    for (std::uint64_t begin = 0; begin < rows.size();) {
+      std::uint64_t end = rows.find('\n', begin);
+      end = (end == std::string_view::npos ? rows.size() : end + 1);
+      fn(rows.substr(begin, end - begin));
+      begin = end;
+    }
+  }
+
+  static auto count_rows(const std::string_view rows) -> std::uint64_t {
+    std::uint64_t count = 0;
+    for_each_row(rows, [&](std::string_view) { ++count; });
+    return count;
+  }
+
+  std::ofstream deleted_, inserted_;
+  pending_groups old_, new_;
+
+  std::uint64_t unchanged_entities_ = 0, changed_entities_ = 0;
+  std::uint64_t inserted_entities_ = 0, deleted_entities_ = 0;
+  std::uint64_t inserted_rows_ = 0, deleted_rows_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_DIFF_HANDLER_H
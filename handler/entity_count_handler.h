@@ -13,41 +13,117 @@
 namespace wd_migrate {
 struct entity_count_handler : public skip_novalue_handler {
 public:
+  using used_columns = detail::wd_column_set<detail::kEntityId>;
+
   auto summary() -> void {
-    std::cout << "# entities: " << entity_counts_.size() << std::endl;
+    std::cout << "# entities: "
+              << entity_counts_.size() + other_entity_counts_.size()
+              << std::endl;
     static const std::array target_counts{1, 2, 3, 4, 5, 10, 100, 1000};
     std::vector<int> counts(std::size(target_counts));
-    for (const auto &[_, cnt] : entity_counts_) {
-      for (int index = 0; index < std::size(target_counts); ++index) {
-        const int limit = target_counts[index];
-        if (cnt <= limit) {
-          ++counts[index];
+    const auto add_counts = [&](const auto &entity_counts) {
+      for (const auto &[_, cnt] : entity_counts) {
+        for (int index = 0; index < std::size(target_counts); ++index) {
+          const int limit = target_counts[index];
+          if (cnt <= limit) {
+            ++counts[index];
+          }
         }
       }
-    }
+    };
+    add_counts(entity_counts_);
+    add_counts(other_entity_counts_);
     for (int index = 0; index < std::size(target_counts); ++index) {
       std::cout << "  edge_count(" << target_counts[index]
                 << "): " << counts[index] << std::endl;
     }
   }
 
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    writer.write(count_);
+    writer.write(entity_counts_);
+    writer.write(other_entity_counts_);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    reader.read(count_);
+    reader.read(entity_counts_);
+    reader.read(other_entity_counts_);
+  }
+
+  // NOTE see handle, rows without a value are skipped.
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    for (const wd_entity_id_t &value :
+         block.template values<wd_entity_id_t>()) {
+      count_value(value);
+    }
+    std::uint64_t row = 0;
+    const auto count_until = [&](std::uint64_t end) {
+      for (; row < end; ++row) {
+        if (!block_type::has_value(block.kind(row))) {
+          continue;
+        }
+        ++count_;
+        if (run_count_ == 0) {
+          run_entity_id_ =
+              block.columns(row).template get_field<detail::kEntityId>();
+        }
+        ++run_count_;
+      }
+    };
+    for (const std::uint32_t end : block.entity_ends()) {
+      count_until(end);
+      end_entity();
+    }
+    count_until(block.size());
+  }
+
 public:
   template <typename columns_type, typename result_type>
   auto handle(const columns_type &columns, const result_type &value) {
     ++count_;
-    const std::string &entity_id =
-        columns.template get_field<detail::kEntityId>();
-    ++entity_counts_[entity_id];
+    // NOTE consecutive rows share the same subject, so we only update the
+    //      table once per run (see end_entity).
+    if (run_count_ == 0) {
+      run_entity_id_ = columns.template get_field<detail::kEntityId>();
+    }
+    ++run_count_;
     if constexpr (std::is_same_v<result_type, wd_entity_id_t>) {
-      ++entity_counts_[value.value];
+      count_value(value);
+    }
+  }
+
+  auto end_entity() -> void {
+    if (run_count_ != 0) {
+      if (run_entity_id_.id() != kNoEntityId) {
+        entity_counts_[run_entity_id_.id()] += run_count_;
+      } else {
+        other_entity_counts_[run_entity_id_.str()] += run_count_;
+      }
+      run_count_ = 0;
     }
   }
 
   using skip_novalue_handler::handle;
 
 private:
-  std::uint64_t count_;
-  std::unordered_map<std::string, std::uint64_t> entity_counts_;
+  auto count_value(const wd_entity_id_t &value) -> void {
+    if (value.id != kNoEntityId) {
+      ++entity_counts_[value.id];
+    } else {
+      ++other_entity_counts_[value.value];
+    }
+  }
+
+  std::uint64_t count_ = 0;
+  // NOTE keyed on the tagged id, entities that are not of the form
+  //      <letter><number> (e.g., L1-F1) are counted by their text.
+  std::unordered_map<std::uint64_t, std::uint64_t> entity_counts_;
+  std::unordered_map<std::string, std::uint64_t> other_entity_counts_;
+
+  detail::wd_id_column run_entity_id_;
+  std::uint64_t run_count_ = 0;
 };
 } // namespace wd_migrate
 
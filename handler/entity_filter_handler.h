@@ -0,0 +1,82 @@
+#ifndef HANDLER_ENTITY_FILTER_HANDLER_H
+#define HANDLER_ENTITY_FILTER_HANDLER_H
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "../parser/wikidata_ids.h"
+#include "../utils/bloom_filter.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// Writes a Bloom filter (see utils/bloom_filter.h) over the tagged ids of all
+// subjects and entity-valued objects of the output.
+struct entity_filter_handler : public skip_novalue_handler {
+public:
+  using used_columns = detail::wd_column_set<detail::kEntityId>;
+
+  // NOTE no filter is written if filename is empty.
+  entity_filter_handler(const std::string &filename,
+                        std::uint64_t bits_per_key = 16)
+      : filename_(filename), builder_(bits_per_key) {}
+
+  auto summary() -> void {
+    if (filename_.empty()) {
+      return;
+    }
+    builder_.write(filename_);
+    std::cout << "entity filter: " << builder_.size() << " entities (skipped: "
+              << skipped_count_ << ")" << std::endl;
+  }
+
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    builder_.save_checkpoint(writer);
+    writer.write(skipped_count_);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    builder_.load_checkpoint(reader);
+    reader.read(skipped_count_);
+  }
+
+public:
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) {
+    if (filename_.empty()) {
+      return;
+    }
+    // NOTE consecutive rows share the same subject (see end_entity).
+    if (!run_has_subject_) {
+      add(columns.template get_field<detail::kEntityId>().id());
+      run_has_subject_ = true;
+    }
+    if constexpr (std::is_same_v<result_type, wd_entity_id_t>) {
+      add(value.id);
+    }
+  }
+
+  auto end_entity() -> void { run_has_subject_ = false; }
+
+  using skip_novalue_handler::handle;
+
+private:
+  // NOTE the ids have already been decoded while reading the row.
+  auto add(std::uint64_t id) -> void {
+    if (id == kNoEntityId) {
+      ++skipped_count_;
+      return;
+    }
+    builder_.add(id);
+  }
+
+  const std::string filename_;
+  utils::bloom_filter_builder builder_;
+  bool run_has_subject_ = false;
+  std::uint64_t skipped_count_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_ENTITY_FILTER_HANDLER_H
@@ -0,0 +1,219 @@
+#ifndef HANDLER_GRAPH_HANDLER_H
+#define HANDLER_GRAPH_HANDLER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../parser/wikidata_ids.h"
+#include "../utils/csr_graph.h"
+#include "../utils/parallel.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// Writes the entity-valued claims as a compressed sparse row graph (see
+// utils/csr_graph.h).
+// NOTE edges are buffered per subject run (the claims are grouped by
+//      entity_id), the CSR is built in parallel once all claims are read.
+// NOTE handlers see the rows on a single thread (also with parse threads,
+//      which hand over the rows in input order), so the edges are buffered
+//      once rather than per thread. The build phases split the runs across
+//      threads instead, each collecting its nodes into its own buffer.
+struct graph_handler : public empty_handler</*fail_if_unhandled=*/false> {
+public:
+  using used_columns =
+      detail::wd_column_set<detail::kEntityId, detail::kPropety>;
+
+  // NOTE no graph is written if filename is empty.
+  graph_handler(const std::string &filename,
+                unsigned thread_count = utils::default_thread_count())
+      : filename_(filename), thread_count_(thread_count) {}
+
+  auto summary() -> void {
+    if (filename_.empty()) {
+      return;
+    }
+    write_graph();
+    std::cout << "graph: " << nodes_.size() << " nodes, " << targets_.size()
+              << " edges (skipped: " << skipped_count_ << ")" << std::endl;
+  }
+
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    writer.write(runs_);
+    writer.write(targets_);
+    writer.write(properties_);
+    writer.write(skipped_count_);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    reader.read(runs_);
+    reader.read(targets_);
+    reader.read(properties_);
+    reader.read(skipped_count_);
+  }
+
+public: // result handlers
+  template <typename columns_type>
+  auto handle(const columns_type &columns, const wd_entity_id_t &value)
+      -> void {
+    if (filename_.empty()) {
+      return;
+    }
+    // NOTE the ids have already been decoded while reading the row.
+    const std::uint64_t target = value.id;
+    const std::uint64_t property =
+        columns.template get_field<detail::kPropety>().id();
+    if (target == kNoEntityId || property == kNoEntityId) {
+      ++skipped_count_;
+      return;
+    }
+    if (run_length_ == 0) {
+      const std::uint64_t subject =
+          columns.template get_field<detail::kEntityId>().id();
+      if (subject == kNoEntityId) {
+        ++skipped_count_;
+        return;
+      }
+      run_subject_ = subject;
+    }
+    ++run_length_;
+    targets_.push_back(target);
+    properties_.push_back(property & kEntityNumberMask);
+  }
+
+  auto end_entity() -> void {
+    if (run_length_ != 0) {
+      runs_.push_back(run{.subject = run_subject_, .end = targets_.size()});
+      run_length_ = 0;
+    }
+  }
+
+  using empty_handler::handle;
+
+private:
+  struct run {
+    std::uint64_t subject;
+    // NOTE edges of the run end at this index into targets_/properties_.
+    std::uint64_t end;
+  };
+
+  auto run_begin(std::uint64_t index) const -> std::uint64_t {
+    return index == 0 ? 0 : runs_[index - 1].end;
+  }
+
+  auto node_id(std::uint64_t entity_id) const -> std::uint32_t {
+    return std::lower_bound(nodes_.begin(), nodes_.end(), entity_id) -
+           nodes_.begin();
+  }
+
+  auto collect_nodes() -> void {
+    std::vector<std::vector<std::uint64_t>> partial(thread_count_);
+    utils::parallel_for(
+        runs_.size(), thread_count_,
+        [&](unsigned thread, std::uint64_t begin, std::uint64_t end) {
+          std::vector<std::uint64_t> &ids = partial[thread];
+          for (std::uint64_t index = begin; index < end; ++index) {
+            ids.push_back(runs_[index].subject);
+            ids.insert(ids.end(), targets_.begin() + run_begin(index),
+                       targets_.begin() + runs_[index].end);
+          }
+          std::sort(ids.begin(), ids.end());
+          ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        });
+    for (std::vector<std::uint64_t> &ids : partial) {
+      std::vector<std::uint64_t> merged;
+      std::set_union(nodes_.begin(), nodes_.end(), ids.begin(), ids.end(),
+                     std::back_inserter(merged));
+      nodes_.swap(merged);
+      ids = {};
+    }
+  }
+
+  auto write_graph() -> void {
+    collect_nodes();
+
+    // Phase 1: count the out-degree of every node.
+    std::vector<std::atomic<std::uint64_t>> cursors(nodes_.size());
+    utils::parallel_for(runs_.size(), thread_count_,
+                        [&](unsigned, std::uint64_t begin, std::uint64_t end) {
+                          for (std::uint64_t index = begin; index < end;
+                               ++index) {
+                            cursors[node_id(runs_[index].subject)].fetch_add(
+                                runs_[index].end - run_begin(index),
+                                std::memory_order_relaxed);
+                          }
+                        });
+    std::vector<std::uint64_t> offsets(nodes_.size() + 1, 0);
+    for (std::uint64_t node = 0; node < nodes_.size(); ++node) {
+      offsets[node + 1] = offsets[node] + cursors[node].load();
+      cursors[node].store(offsets[node]);
+    }
+
+    // Phase 2: scatter the edges and sort them per node.
+    std::vector<utils::csr_edge> edges(targets_.size());
+    utils::parallel_for(
+        runs_.size(), thread_count_,
+        [&](unsigned, std::uint64_t begin, std::uint64_t end) {
+          for (std::uint64_t index = begin; index < end; ++index) {
+            const std::uint64_t first = run_begin(index);
+            const std::uint64_t length = runs_[index].end - first;
+            std::uint64_t position =
+                cursors[node_id(runs_[index].subject)].fetch_add(
+                    length, std::memory_order_relaxed);
+            for (std::uint64_t edge = first; edge < first + length; ++edge) {
+              edges[position++] = utils::csr_edge{
+                  .property = properties_[edge],
+                  .target = node_id(targets_[edge])};
+            }
+          }
+        });
+    utils::parallel_for(
+        nodes_.size(), thread_count_,
+        [&](unsigned, std::uint64_t begin, std::uint64_t end) {
+          for (std::uint64_t node = begin; node < end; ++node) {
+            std::sort(edges.begin() + offsets[node],
+                      edges.begin() + offsets[node + 1]);
+          }
+        });
+
+    utils::csr_header header;
+    std::copy(std::begin(utils::kCSRMagic), std::end(utils::kCSRMagic),
+              header.magic);
+    header.node_count = nodes_.size();
+    header.edge_count = edges.size();
+    header.nodes_offset = sizeof(header);
+    header.offsets_offset =
+        header.nodes_offset + sizeof(std::uint64_t) * nodes_.size();
+    header.edges_offset =
+        header.offsets_offset + sizeof(std::uint64_t) * offsets.size();
+
+    std::ofstream output(filename_, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(nodes_.data()),
+                 sizeof(std::uint64_t) * nodes_.size());
+    output.write(reinterpret_cast<const char *>(offsets.data()),
+                 sizeof(std::uint64_t) * offsets.size());
+    output.write(reinterpret_cast<const char *>(edges.data()),
+                 sizeof(utils::csr_edge) * edges.size());
+  }
+
+  const std::string filename_;
+  const unsigned thread_count_;
+
+  // Edges of the current subject run.
+  std::uint64_t run_subject_ = 0, run_length_ = 0;
+
+  std::vector<run> runs_;
+  std::vector<std::uint64_t> targets_;
+  std::vector<std::uint32_t> properties_;
+  std::vector<std::uint64_t> nodes_;
+  std::uint64_t skipped_count_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_GRAPH_HANDLER_H
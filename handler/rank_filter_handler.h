@@ -0,0 +1,148 @@
+#ifndef HANDLER_RANK_FILTER_HANDLER_H
+#define HANDLER_RANK_FILTER_HANDLER_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "row_buffer.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+enum class rank_filter_mode {
+  // Forward every statement.
+  all,
+  // Drop deprecated statements.
+  non_deprecated,
+  // Keep only best-rank statements per (entity, property), i.e., the
+  // preferred statements if there are any and the normal ones otherwise.
+  best_rank
+};
+
+// Filters the statements forwarded to the wrapped handler by their rank.
+// NOTE this relies on the claims being grouped by entity_id, which allows
+//      selecting the best rank while buffering a single entity at a time
+//      until end_entity() is called.
+template <typename handler_type> struct rank_filter_handler {
+public:
+  using used_columns = detail::wd_column_set_union_t<
+      detail::wd_column_set<detail::kClaimsRank, detail::kPropety>,
+      typename handler_type::used_columns>;
+
+  rank_filter_handler(rank_filter_mode mode, handler_type &&handler)
+      : mode_(mode), handler_(std::move(handler)) {}
+
+  auto summary() -> void {
+    std::cout << "rank filter: forwarded " << forwarded_count_ << " of "
+              << row_count_ << " rows (deprecated: " << deprecated_count_
+              << ")" << std::endl;
+    handler_.summary();
+  }
+
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    writer.write(row_count_);
+    writer.write(forwarded_count_);
+    writer.write(deprecated_count_);
+    handler_.save_checkpoint(writer);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    reader.read(row_count_);
+    reader.read(forwarded_count_);
+    reader.read(deprecated_count_);
+    handler_.load_checkpoint(reader);
+  }
+
+  // NOTE only unfiltered blocks are forwarded as a whole.
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    if (mode_ != rank_filter_mode::all) {
+      block.replay(*this);
+      return;
+    }
+    row_count_ += block.size();
+    forwarded_count_ += block.size();
+    handle_block(handler_, block);
+  }
+
+public: // result handlers
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) -> void {
+    ++row_count_;
+    if (mode_ == rank_filter_mode::all) {
+      ++forwarded_count_;
+      handler_.handle(columns, value);
+      return;
+    }
+    const detail::wd_rank_column &rank =
+        columns.template get_field<detail::kClaimsRank>();
+    if (is_deprecated(rank)) {
+      ++deprecated_count_;
+      return;
+    }
+    if (mode_ == rank_filter_mode::non_deprecated) {
+      ++forwarded_count_;
+      handler_.handle(columns, value);
+      return;
+    }
+    const detail::wd_id_column &property =
+        columns.template get_field<detail::kPropety>();
+    if (is_preferred(rank)) {
+      preferred_properties_.insert(property);
+    }
+    buffer_.push(columns, value);
+    preferred_.push_back(is_preferred(rank));
+    properties_.push_back(property);
+  }
+
+  auto end_entity() -> void {
+    if (mode_ == rank_filter_mode::best_rank) {
+      flush_entity();
+    }
+    handler_.end_entity();
+  }
+
+private:
+  // NOTE rank is one of "preferred", "normal" or "deprecated".
+  static auto is_preferred(const detail::wd_rank_column &rank) -> bool {
+    return rank.code() == detail::wd_rank_column::code_of("preferred");
+  }
+  static auto is_deprecated(const detail::wd_rank_column &rank) -> bool {
+    return rank.code() == detail::wd_rank_column::code_of("deprecated");
+  }
+
+  auto flush_entity() -> void {
+    selection_.clear();
+    for (std::uint32_t index = 0; index < preferred_.size(); ++index) {
+      if (preferred_[index] ||
+          !preferred_properties_.contains(properties_[index])) {
+        selection_.push_back(index);
+      }
+    }
+    forwarded_count_ += selection_.size();
+    buffer_.replay(handler_, selection_);
+    buffer_.clear();
+    preferred_.clear();
+    properties_.clear();
+    preferred_properties_.clear();
+  }
+
+  const rank_filter_mode mode_;
+  handler_type handler_;
+
+  // State of the entity currently being buffered.
+  detail::row_buffer<handler_type> buffer_;
+  std::vector<bool> preferred_;
+  std::vector<detail::wd_id_column> properties_;
+  std::unordered_set<detail::wd_id_column, detail::wd_id_column::hash>
+      preferred_properties_;
+  std::vector<std::uint32_t> selection_;
+
+  std::uint64_t row_count_ = 0, forwarded_count_ = 0, deprecated_count_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_RANK_FILTER_HANDLER_H
@@ -0,0 +1,198 @@
+#ifndef HANDLER_ROW_BLOCK_H
+#define HANDLER_ROW_BLOCK_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../parser/wikidata_columns.h"
+#include "../utils/arena.h"
+
+namespace wd_migrate {
+namespace detail {
+// The values of a single kind in a row_block, along with the rows (i.e., the
+// selection vector) they belong to.
+template <typename value_type> struct row_block_values {
+  auto push(std::uint32_t row, const value_type &value) -> void {
+    values.push_back(value);
+    rows.push_back(row);
+  }
+
+  auto clear() -> void {
+    values.clear();
+    rows.clear();
+  }
+
+  std::vector<value_type> values;
+  std::vector<std::uint32_t> rows;
+};
+
+template <typename variant> struct row_block_storage;
+template <typename... types> struct row_block_storage<std::variant<types...>> {
+  using type = std::tuple<row_block_values<types>...>;
+};
+} // namespace detail
+
+// A block of up to kCapacity rows in columnar form, handed to handle_batch:
+// the columns of every row, the kind of the value of every row and, per
+// kind, the typed values along with a selection vector of their rows.
+// NOTE the block also records the entity boundaries, i.e., handle_batch
+//      replaces both handle() and end_entity() for the rows of the block.
+// NOTE the block is filled through handle() and end_entity(), so it can be
+//      passed to the datavalue parsers in place of a result handler. The
+//      column packs are reused across blocks, i.e., reading a row into
+//      next_columns() does not allocate once their strings have grown.
+// NOTE blocks are kept small enough for their columns to stay in cache, as
+//      the rows are typically walked more than once.
+// NOTE the block owns an arena for the scratch allocations of parsing its
+//      rows (see arena()), which is reset along with the block.
+template <typename columns_type> class row_block {
+public:
+  static constexpr std::uint64_t kCapacity = 256;
+  static constexpr std::uint64_t kKindCount =
+      std::variant_size_v<wd_value_t>;
+
+  row_block() : columns_(kCapacity), kinds_(kCapacity) {}
+
+  template <typename result_type>
+  auto handle(const columns_type &columns, const result_type &value)
+      -> void {
+    static constexpr std::uint64_t kind = detail::kValueKind<result_type>;
+    if (&columns != &columns_[size_]) {
+      columns_[size_] = columns;
+    }
+    kinds_[size_] = kind;
+    std::get<kind>(values_).push(size_, value);
+    ++counts_[kind];
+    ++size_;
+  }
+
+  auto end_entity() -> void { entity_ends_.push_back(size_); }
+
+  // NOTE the slot of the next row, i.e., a row read into it is handled
+  //      without copying its columns. Not valid once the block is full.
+  auto next_columns() -> columns_type & { return columns_[size_]; }
+
+  // NOTE allocations are released once the block is cleared, i.e., after
+  //      it has been handled.
+  auto arena() -> utils::arena & { return arena_; }
+
+  auto full() const -> bool { return size_ == kCapacity; }
+  auto empty() const -> bool { return size_ == 0 && entity_ends_.empty(); }
+  auto size() const -> std::uint64_t { return size_; }
+
+  auto columns(std::uint64_t row) const -> const columns_type & {
+    return columns_[row];
+  }
+  auto kind(std::uint64_t row) const -> std::uint8_t { return kinds_[row]; }
+
+  // NOTE novalue and invalid values have no value, i.e., kind >= kValueKinds.
+  static constexpr auto has_value(std::uint8_t kind) -> bool {
+    return kind < kValueKinds;
+  }
+
+  template <typename value_type>
+  auto values() const -> std::span<const value_type> {
+    return std::get<detail::kValueKind<value_type>>(values_).values;
+  }
+
+  // NOTE the (ascending) rows holding a value of the given type.
+  template <typename value_type>
+  auto selection() const -> std::span<const std::uint32_t> {
+    return std::get<detail::kValueKind<value_type>>(values_).rows;
+  }
+
+  auto count(std::uint64_t kind) const -> std::uint64_t {
+    return counts_[kind];
+  }
+
+  // NOTE end_entity() is called once the first entity_ends()[i] rows have
+  //      been handled.
+  auto entity_ends() const -> std::span<const std::uint32_t> {
+    return entity_ends_;
+  }
+
+  // Hands the rows to handler one by one (in order), i.e., the per-row path
+  // for handlers without handle_batch.
+  template <typename handler_type>
+  auto replay(handler_type &handler) const -> void {
+    static const auto kReplayers = make_replayers<handler_type>(
+        std::make_index_sequence<kKindCount>());
+    std::array<std::uint32_t, kKindCount> cursors{};
+    std::uint64_t row = 0;
+    const auto replay_until = [&](std::uint64_t end) {
+      for (; row < end; ++row) {
+        const std::uint8_t kind = kinds_[row];
+        kReplayers[kind](*this, handler, row, cursors[kind]++);
+      }
+    };
+    for (const std::uint32_t end : entity_ends_) {
+      replay_until(end);
+      handler.end_entity();
+    }
+    replay_until(size_);
+  }
+
+  auto clear() -> void {
+    std::apply([](auto &...typed) { (typed.clear(), ...); }, values_);
+    entity_ends_.clear();
+    counts_.fill(0);
+    size_ = 0;
+    arena_.reset();
+  }
+
+private:
+  static constexpr std::uint64_t kValueKinds =
+      detail::kValueKind<wd_novalue_t<wd_string_t>>;
+
+  template <typename handler_type>
+  using replay_fn = void (*)(const row_block &, handler_type &, std::uint64_t,
+                             std::uint32_t);
+
+  template <typename handler_type, std::size_t... kinds>
+  static auto make_replayers(std::index_sequence<kinds...>)
+      -> std::array<replay_fn<handler_type>, sizeof...(kinds)> {
+    return {[](const row_block &block, handler_type &handler,
+               std::uint64_t row, std::uint32_t index) {
+      handler.handle(block.columns_[row],
+                     std::get<kinds>(block.values_).values[index]);
+    }...};
+  }
+
+  std::vector<columns_type> columns_;
+  std::vector<std::uint8_t> kinds_;
+  typename detail::row_block_storage<wd_value_t>::type values_;
+  std::vector<std::uint32_t> entity_ends_;
+  std::array<std::uint64_t, kKindCount> counts_{};
+  std::uint64_t size_ = 0;
+  utils::arena arena_;
+};
+
+// Handlers may additionally implement handle_batch(block), which receives a
+// row_block instead of its rows one by one.
+// NOTE a handler implementing handle_batch sees the whole block before the
+//      handlers after it in the stack, so it must not rely on being called
+//      in lockstep with them (e.g., through shared state).
+template <typename handler_type, typename block_type>
+concept batch_handler = requires(handler_type &handler,
+                                 const block_type &block) {
+  handler.handle_batch(block);
+};
+
+// Hands block to handler, falling back to the per-row path for handlers
+// without handle_batch.
+template <typename handler_type, typename block_type>
+auto handle_block(handler_type &handler, const block_type &block) -> void {
+  if constexpr (batch_handler<handler_type, block_type>) {
+    handler.handle_batch(block);
+  } else {
+    block.replay(handler);
+  }
+}
+} // namespace wd_migrate
+
+#endif // !HANDLER_ROW_BLOCK_H
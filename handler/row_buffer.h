@@ -0,0 +1,107 @@
+#ifndef HANDLER_ROW_BUFFER_H
+#define HANDLER_ROW_BUFFER_H
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../parser/wikidata_columns.h"
+
+namespace wd_migrate::detail {
+// Owned copies of handled rows that can be replayed into a handler later on.
+// NOTE the column pack type is only known once the first row is pushed, so
+//      the storage is created lazily and erased behind a single virtual call
+//      per replay.
+template <typename handler_type> struct row_buffer {
+public:
+  template <typename columns_type, typename result_type>
+  auto push(const columns_type &columns, const result_type &value) -> void {
+    if (!rows_) {
+      rows_ = std::make_unique<typed_rows<columns_type>>();
+    }
+    static_cast<typed_rows<columns_type> &>(*rows_).rows.emplace_back(
+        columns, wd_value_t(value));
+  }
+
+  auto replay(handler_type &handler) -> void {
+    if (rows_) {
+      rows_->replay(handler);
+    }
+  }
+
+  // NOTE selection holds ascending row indices.
+  auto replay(handler_type &handler,
+              const std::vector<std::uint32_t> &selection) -> void {
+    if (rows_) {
+      rows_->replay(handler, selection);
+    }
+  }
+
+  // NOTE replays the rows in [begin, end).
+  auto replay(handler_type &handler, std::uint64_t begin, std::uint64_t end)
+      -> void {
+    if (rows_) {
+      rows_->replay(handler, begin, end);
+    }
+  }
+
+  auto size() const -> std::uint64_t { return rows_ ? rows_->size() : 0; }
+
+  auto clear() -> void {
+    if (rows_) {
+      rows_->clear();
+    }
+  }
+
+private:
+  struct rows_base {
+    virtual ~rows_base() = default;
+    virtual auto replay(handler_type &handler) -> void = 0;
+    virtual auto replay(handler_type &handler,
+                        const std::vector<std::uint32_t> &selection)
+        -> void = 0;
+    virtual auto replay(handler_type &handler, std::uint64_t begin,
+                        std::uint64_t end) -> void = 0;
+    virtual auto size() const -> std::uint64_t = 0;
+    virtual auto clear() -> void = 0;
+  };
+
+  template <typename columns_type> struct typed_rows : public rows_base {
+    auto replay(handler_type &handler) -> void override {
+      for (const auto &[columns, value] : rows) {
+        replay_row(handler, columns, value);
+      }
+    }
+    auto replay(handler_type &handler,
+                const std::vector<std::uint32_t> &selection) -> void override {
+      for (const std::uint32_t index : selection) {
+        const auto &[columns, value] = rows[index];
+        replay_row(handler, columns, value);
+      }
+    }
+    auto replay(handler_type &handler, std::uint64_t begin,
+                std::uint64_t end) -> void override {
+      for (std::uint64_t index = begin; index < end; ++index) {
+        const auto &[columns, value] = rows[index];
+        replay_row(handler, columns, value);
+      }
+    }
+    auto size() const -> std::uint64_t override { return rows.size(); }
+    auto clear() -> void override { rows.clear(); }
+
+    static auto replay_row(handler_type &handler, const columns_type &columns,
+                           const wd_value_t &value) -> void {
+      std::visit([&](const auto &result) { handler.handle(columns, result); },
+                 value);
+    }
+
+    std::vector<std::pair<columns_type, wd_value_t>> rows;
+  };
+
+  std::unique_ptr<rows_base> rows_;
+};
+} // namespace wd_migrate::detail
+
+#endif // !HANDLER_ROW_BUFFER_H
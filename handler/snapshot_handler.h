@@ -0,0 +1,68 @@
+#ifndef HANDLER_SNAPSHOT_HANDLER_H
+#define HANDLER_SNAPSHOT_HANDLER_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../parser/wikidata_snapshot.h"
+#include "../utils/snapshot_file.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// Writes every row (including novalue/invalid rows) with its parsed value to
+// a columnar snapshot (see parser/wikidata_snapshot.h), which can be used as
+// input instead of the TSV dump.
+template <typename tag>
+struct snapshot_handler : public empty_handler</*fail_if_unhandled=*/false> {
+public:
+  using used_columns = detail::snapshot_columns_t<tag>;
+
+  snapshot_handler(const std::string &filename)
+      : file_(filename), values_(file_), claim_ids_(file_) {
+    used_columns::for_each([&]<const char *column_name>() {
+      if constexpr (detail::kSnapshotColumnStored<column_name>) {
+        columns_.emplace_back(file_, column_name,
+                              detail::snapshot_encoding_of(column_name));
+      }
+    });
+  }
+
+  auto summary() -> void {
+    file_.finish(detail::kSnapshotTag<tag>, row_count_);
+    std::cout << "snapshot: " << row_count_ << " rows" << std::endl;
+  }
+
+public: // result handlers
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) -> void {
+    std::uint64_t index = 0;
+    used_columns::for_each([&]<const char *column_name>() {
+      const auto &field = columns.template get_field<column_name>();
+      using field_type = std::decay_t<decltype(field)>;
+      if constexpr (std::is_same_v<field_type, wd_claim_id_t>) {
+        claim_ids_.push(field);
+      } else if constexpr (std::is_same_v<field_type, detail::wd_id_column>) {
+        wd_entity_id_buffer buffer;
+        columns_[index++].push(field.view(buffer));
+      } else {
+        columns_[index++].push(field);
+      }
+    });
+    values_.push(value);
+    ++row_count_;
+  }
+
+private:
+  utils::snapshot_writer file_;
+  detail::snapshot_value_writer values_;
+  detail::snapshot_claim_id_writer claim_ids_;
+  std::vector<utils::snapshot_column_writer> columns_;
+  std::uint64_t row_count_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_SNAPSHOT_HANDLER_H
@@ -0,0 +1,156 @@
+#ifndef HANDLER_THREADED_HANDLER_H
+#define HANDLER_THREADED_HANDLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../utils/spsc_ring.h"
+#include "row_buffer.h"
+#include "wikidata_handler.h"
+
+namespace wd_migrate {
+// Runs the wrapped handler (e.g., a stacked_handler) on its own thread, so
+// that it runs concurrently with the handlers before it in the stack.
+// NOTE rows are copied into batches of kBatchRows rows and handed to the
+//      thread through a bounded SPSC ring. Batches are recycled through a
+//      second ring, i.e., at most kBatchCount batches are in flight and the
+//      parsing thread blocks once the wrapped handler falls behind.
+// NOTE the wrapped handler must not share state with the rest of the stack.
+template <typename handler_type> struct threaded_handler {
+public:
+  using used_columns = typename handler_type::used_columns;
+
+  threaded_handler(handler_type &&handler)
+      : pipeline_(std::make_unique<pipeline>(std::move(handler))) {}
+
+  auto summary() -> void {
+    send_batch();
+    pipeline_->stop();
+    std::cout << "threaded handler: " << pipeline_->batch_count
+              << " batches (parser blocked on " << blocked_count_ << ")"
+              << std::endl;
+    pipeline_->handler.summary();
+  }
+
+  // NOTE waits for the thread to handle all pending rows first.
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    send_batch();
+    pipeline_->wait_idle(sent_count_);
+    pipeline_->handler.save_checkpoint(writer);
+  }
+
+  // NOTE called before any row is handed to the thread.
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    pipeline_->handler.load_checkpoint(reader);
+  }
+
+public: // result handlers
+  template <typename columns_type, typename result_type>
+  auto handle(const columns_type &columns, const result_type &value) -> void {
+    current_batch().rows.push(columns, value);
+    if (batch_->rows.size() >= kBatchRows) {
+      send_batch();
+    }
+  }
+
+  auto end_entity() -> void {
+    current_batch().entity_ends.push_back(batch_->rows.size());
+  }
+
+private:
+  static constexpr std::uint64_t kBatchRows = 4096;
+  static constexpr std::uint64_t kBatchCount = 8;
+
+  struct batch {
+    detail::row_buffer<handler_type> rows;
+    // NOTE end_entity() is called after this many rows of the batch.
+    std::vector<std::uint64_t> entity_ends;
+  };
+
+  // NOTE owns everything the thread touches, so the handler stays movable.
+  struct pipeline {
+    pipeline(handler_type &&wrapped)
+        : handler(std::move(wrapped)), pending(kBatchCount),
+          recycled(kBatchCount) {
+      for (std::uint64_t index = 0; index < kBatchCount; ++index) {
+        recycled.push(std::make_unique<batch>());
+      }
+      thread = std::thread([this]() { run(); });
+    }
+
+    ~pipeline() { stop(); }
+
+    auto run() -> void {
+      while (std::optional<std::unique_ptr<batch>> next = pending.pop()) {
+        batch &rows = **next;
+        std::uint64_t begin = 0;
+        for (const std::uint64_t end : rows.entity_ends) {
+          rows.rows.replay(handler, begin, end);
+          handler.end_entity();
+          begin = end;
+        }
+        rows.rows.replay(handler, begin, rows.rows.size());
+        rows.rows.clear();
+        rows.entity_ends.clear();
+        recycled.push(std::move(*next));
+        handled_count.fetch_add(1, std::memory_order_release);
+        handled_count.notify_one();
+        ++batch_count;
+      }
+    }
+
+    auto wait_idle(std::uint64_t sent_count) -> void {
+      std::uint64_t handled = handled_count.load(std::memory_order_acquire);
+      while (handled != sent_count) {
+        handled_count.wait(handled, std::memory_order_acquire);
+        handled = handled_count.load(std::memory_order_acquire);
+      }
+    }
+
+    auto stop() -> void {
+      if (thread.joinable()) {
+        pending.close();
+        thread.join();
+      }
+    }
+
+    handler_type handler;
+    utils::spsc_ring<std::unique_ptr<batch>> pending, recycled;
+    std::atomic<std::uint64_t> handled_count{0};
+    std::uint64_t batch_count = 0;
+    std::thread thread;
+  };
+
+  auto current_batch() -> batch & {
+    if (!batch_) {
+      std::optional<std::unique_ptr<batch>> next =
+          pipeline_->recycled.try_pop();
+      if (!next.has_value()) {
+        ++blocked_count_;
+        next = pipeline_->recycled.pop();
+      }
+      batch_ = std::move(*next);
+    }
+    return *batch_;
+  }
+
+  auto send_batch() -> void {
+    if (batch_) {
+      pipeline_->pending.push(std::move(batch_));
+      ++sent_count_;
+    }
+  }
+
+  std::unique_ptr<pipeline> pipeline_;
+  std::unique_ptr<batch> batch_;
+  std::uint64_t sent_count_ = 0, blocked_count_ = 0;
+};
+} // namespace wd_migrate
+
+#endif // !HANDLER_THREADED_HANDLER_H
@@ -1,6 +1,7 @@
 #ifndef HANDLER_WIKIDATA_HANDLER_H
 #define HANDLER_WIKIDATA_HANDLER_H
 
+#include <array>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
@@ -9,9 +10,14 @@
 #include <utility>
 
 #include "../parser/wikidata_columns.h"
+#include "../utils/checkpoint.h"
+#include "row_block.h"
 
 namespace wd_migrate {
 template <bool fail_if_unhandled = false> struct empty_handler {
+  // NOTE columns not used by any handler in the stack are never copied.
+  using used_columns = detail::wd_column_set<>;
+
   template <typename columns_type, typename result_type>
   auto handle(const columns_type &columns, const result_type &value) -> void {
     if constexpr (fail_if_unhandled) {
@@ -21,6 +27,14 @@ template <bool fail_if_unhandled = false> struct empty_handler {
       std::exit(-1);
     }
   }
+
+  // NOTE called once all rows of the current entity have been handled.
+  auto end_entity() -> void {}
+
+  // NOTE checkpoints are only taken between entities, so state that is
+  //      reset by end_entity() does not need to be saved.
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {}
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {}
 };
 
 struct skip_novalue_handler : public empty_handler</*fail_if_unhandled=*/true> {
@@ -38,14 +52,25 @@ public:
 template <typename... handlers> struct stacked_handler;
 
 template <> struct stacked_handler<> {
+  using used_columns = detail::wd_column_set<>;
+
   template <typename columns_type, typename result_type>
   auto handle(const columns_type &columns, const result_type &value) {}
+  template <typename block_type> auto handle_batch(const block_type &block) {}
+  auto end_entity() -> void {}
   auto summary() -> void {}
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {}
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {}
 };
 
 template <typename head_type, typename... tail>
 struct stacked_handler<head_type, tail...> {
 public:
+  using used_columns =
+      detail::wd_column_set_union_t<typename head_type::used_columns,
+                                    typename stacked_handler<
+                                        tail...>::used_columns>;
+
   template <typename... tail_args_types>
   stacked_handler(head_type &&head, tail_args_types &&...tail_args)
       : head_(std::move(head)),
@@ -57,11 +82,38 @@ public:
     tail_.handle(columns, value);
   }
 
+  // NOTE once a handler without handle_batch is reached, the remaining
+  //      handlers receive the rows one by one (interleaved, as for handle).
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    if constexpr (batch_handler<head_type, block_type>) {
+      head_.handle_batch(block);
+      tail_.handle_batch(block);
+    } else {
+      block.replay(*this);
+    }
+  }
+
+  auto end_entity() -> void {
+    head_.end_entity();
+    tail_.end_entity();
+  }
+
   auto summary() -> void {
     head_.summary();
     tail_.summary();
   }
 
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    head_.save_checkpoint(writer);
+    tail_.save_checkpoint(writer);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    head_.load_checkpoint(reader);
+    tail_.load_checkpoint(reader);
+  }
+
   template <typename handler_type> auto &get() {
     if constexpr (std::is_same_v<head_type, handler_type>) {
       return head_;
@@ -81,6 +133,11 @@ stacked_handler(args &&...) -> stacked_handler<args...>;
 template <const bool print_illegal_values = false>
 struct stats_handler : public empty_handler</*fail_if_unhandled=*/true> {
 public:
+  using used_columns =
+      std::conditional_t<print_illegal_values,
+                         detail::wd_column_set<detail::kDatavalueString>,
+                         detail::wd_column_set<>>;
+
   auto summary() -> void {
     std::cout << "row count: " << row_count_ << std::endl;
 
@@ -136,6 +193,32 @@ public:
               << "coordinate: " << iv_coordinate_ << std::endl;
   }
 
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    for (const std::uint64_t *counter : counters()) {
+      writer.write(*counter);
+    }
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    for (std::uint64_t *counter : counters()) {
+      reader.read(*counter);
+    }
+  }
+
+  // NOTE the value counters are in the order of the kinds of wd_value_t.
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    if constexpr (print_illegal_values) {
+      block.replay(*this);
+    } else {
+      const std::array<std::uint64_t *, 19> counters = this->counters();
+      *counters[0] += block.size();
+      for (std::uint64_t kind = 0; kind < block_type::kKindCount; ++kind) {
+        *counters[kind + 1] += block.count(kind);
+      }
+    }
+  }
+
 public: // result handlers
   template <typename columns_type>
   auto handle(const columns_type &columns, const wd_string_t &value) -> void {
@@ -235,6 +318,13 @@ public: // result handlers
   using empty_handler::handle;
 
 private:
+  auto counters() -> std::array<std::uint64_t *, 19> {
+    return {&row_count_, &ct_string_, &ct_entity_, &ct_text_, &ct_time_,
+            &ct_quantity_, &ct_coordinate_, &nv_string_, &nv_entity_, &nv_text_,
+            &nv_time_, &nv_quantity_, &nv_coordinate_, &iv_string_, &iv_entity_,
+            &iv_text_, &iv_time_, &iv_quantity_, &iv_coordinate_};
+  }
+
   std::uint64_t row_count_ = 0;
 
   // "novalue" counts.
@@ -257,9 +347,33 @@ public:
               << ", scale: " << fractional_ << std::endl;
   }
 
+  auto save_checkpoint(utils::checkpoint_writer &writer) -> void {
+    writer.write(integer_);
+    writer.write(fractional_);
+  }
+
+  auto load_checkpoint(utils::checkpoint_reader &reader) -> void {
+    reader.read(integer_);
+    reader.read(fractional_);
+  }
+
+  template <typename block_type>
+  auto handle_batch(const block_type &block) -> void {
+    for (const wd_quantity_t &value : block.template values<wd_quantity_t>()) {
+      update(value);
+    }
+  }
+
 public: // result handlers
   template <typename columns_type>
   auto handle(const columns_type &columns, const wd_quantity_t &value) -> void {
+    update(value);
+  }
+
+  using empty_handler::handle;
+
+private:
+  auto update(const wd_quantity_t &value) -> void {
     const auto dot_index = value.quantity.find(".");
     if (dot_index != std::string::npos) {
       integer_ = std::max(integer_, static_cast<std::uint64_t>(dot_index) - 1);
@@ -271,9 +385,6 @@ public: // result handlers
     }
   }
 
-  using empty_handler::handle;
-
-private:
   std::uint64_t integer_ = 0, fractional_ = 0;
 };
 
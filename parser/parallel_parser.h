@@ -0,0 +1,461 @@
+#ifndef PARSER_PARALLEL_PARSER_H
+#define PARSER_PARALLEL_PARSER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../fast-cpp-csv-parser/csv.h"
+#include "../handler/row_block.h"
+#include "../utils/mpmc_ring.h"
+#include "../utils/progress_indicator.h"
+#include "../utils/quarantine.h"
+#include "../utils/spsc_ring.h"
+#include "../utils/work_stealing_deque.h"
+#include "wikidata_columns.h"
+#include "wikidata_parser.h"
+
+namespace wd_migrate::detail {
+// Parses a TSV dump in three stages: a reader thread splits the input into
+// chunks of lines, thread_count parser threads tokenize and parse the chunks
+// into row_blocks, and the calling thread (the writer) hands the blocks to
+// the handler in input order.
+// NOTE the handler sees exactly the rows, entity boundaries and order of the
+//      sequential wikidata_parser_impl, i.e., it runs on a single thread.
+// NOTE at most 2 * thread_count + 2 chunks are in flight. The reader blocks
+//      once all of them wait to be parsed or written, so memory stays flat.
+// NOTE the writer quarantines the malformed rows of a segment once the
+//      segment has been handled, so it may stop at a slightly later row.
+template <typename tag, typename result_handler,
+          typename parser = wd_primitives_parser>
+class parallel_parser_impl {
+  using sequential_parser = wikidata_parser_impl<tag, result_handler, parser>;
+  using columns_type = typename sequential_parser::columns_type;
+  using csv_reader = typename sequential_parser::csv_reader;
+  using clock = std::chrono::steady_clock;
+
+public:
+  auto parse(const std::string &filename, result_handler *handler,
+             unsigned thread_count,
+             const utils::quarantine_options &quarantine = {}) -> void {
+    quarantine_.open(quarantine, /*resume=*/false);
+    const std::uint64_t chunk_count = 2 * thread_count + 2;
+    std::vector<std::unique_ptr<chunk>> chunks;
+    utils::spsc_ring<chunk *> free_chunks(chunk_count);
+    for (std::uint64_t index = 0; index < chunk_count; ++index) {
+      chunks.push_back(std::make_unique<chunk>());
+      free_chunks.push(chunks.back().get());
+    }
+    utils::mpmc_ring<chunk *> pending(chunk_count + 1);
+    // NOTE chunk i is handed to the writer through parsed[i % chunk_count],
+    //      which is free again once chunk i - chunk_count has been written.
+    std::vector<std::atomic<chunk *>> parsed(chunk_count);
+
+    parsers_ = std::vector<parser>(thread_count);
+    workers_ = std::vector<worker>(thread_count);
+    const clock::time_point start = clock::now();
+    std::thread reader([&]() { read(filename, free_chunks, pending); });
+    std::vector<std::thread> parser_threads;
+    for (unsigned thread = 0; thread < thread_count; ++thread) {
+      parser_threads.emplace_back([&, thread]() {
+        run(filename, thread, pending, parsed);
+      });
+    }
+    write(filename, handler, free_chunks, parsed);
+    reader.join();
+    for (std::thread &thread : parser_threads) {
+      thread.join();
+    }
+    elapsed_ = clock::now() - start;
+  }
+
+  // NOTE a stage is busy while it does not wait for the stages around it,
+  //      i.e., the bottleneck is the stage closest to 100%.
+  auto summary() -> void {
+    clock::duration parser_waiting{};
+    std::uint64_t steal_count = 0, split_count = 0;
+    for (const worker &state : workers_) {
+      parser_waiting += state.waiting;
+      steal_count += state.steal_count;
+      split_count += state.split_count;
+    }
+    std::cout << "pipeline: reader " << busy_percent(reader_waiting_, 1)
+              << "% busy, " << workers_.size() << " parsers "
+              << busy_percent(parser_waiting, workers_.size())
+              << "% busy, writer " << busy_percent(writer_waiting_, 1)
+              << "% busy" << std::endl;
+    std::cout << "pipeline: " << chunk_count_ << " chunks (avg. "
+              << (chunk_count_ == 0 ? 0 : line_count_ / chunk_count_)
+              << " lines), " << split_count << " splits, " << steal_count
+              << " steals" << std::endl;
+    for (std::uint64_t index = 1; index < parsers_.size(); ++index) {
+      parsers_[0].merge_stats(parsers_[index]);
+    }
+    parsers_[0].summary();
+    quarantine_.summary();
+  }
+
+private:
+  // NOTE lines per segment, i.e., the smallest unit of work of the parser
+  //      threads. Every segment is parsed into a single row_block.
+  static constexpr std::uint64_t kSegmentLines =
+      row_block<columns_type>::kCapacity;
+  // NOTE chunk sizes adapt to the measured parse time per line, so that a
+  //      chunk takes about kChunkTime to parse.
+  static constexpr std::uint64_t kInitialChunkSegments = 16;
+  static constexpr std::uint64_t kMaxChunkSegments = 256;
+  static constexpr std::chrono::nanoseconds kChunkTime =
+      std::chrono::milliseconds(4);
+  static constexpr std::uint64_t kDequeCapacity = 1024;
+
+  struct quarantined_row {
+    std::uint64_t line;
+    std::string reason, datavalue_type, datavalue_string;
+  };
+
+  struct segment {
+    row_block<columns_type> rows;
+    std::vector<quarantined_row> quarantined;
+    // NOTE empty for inputs without entities (i.e., for qualifiers).
+    wd_id_column first_entity_id, last_entity_id;
+  };
+
+  struct chunk {
+    std::uint64_t sequence = 0;
+    // NOTE the number of lines before the chunk. Chunks without lines mark
+    //      the end of the input.
+    std::uint64_t first_line = 0, line_count = 0;
+    std::string lines;
+    // NOTE the offset of every line in lines, followed by lines.size().
+    std::vector<std::uint64_t> line_offsets;
+
+    std::vector<segment> segments;
+    std::uint64_t segment_count = 0;
+    // NOTE the chunk is handed to the writer once all segments are parsed.
+    std::atomic<std::uint64_t> remaining_segments{0};
+  };
+
+  // NOTE the segments [begin, end) of a chunk.
+  struct task {
+    chunk *rows = nullptr;
+    std::uint64_t begin = 0, end = 0;
+  };
+
+  struct worker {
+    worker() : tasks(kDequeCapacity) {}
+
+    utils::work_stealing_deque<task> tasks;
+    clock::duration waiting{};
+    std::uint64_t steal_count = 0, split_count = 0;
+  };
+
+  auto read(const std::string &filename,
+            utils::spsc_ring<chunk *> &free_chunks,
+            utils::mpmc_ring<chunk *> &pending) -> void {
+    io::LineReader reader(filename);
+    std::uint64_t line = 0;
+    for (std::uint64_t sequence = 0;; ++sequence) {
+      const std::uint64_t chunk_lines = next_chunk_lines();
+      chunk &next = **take(free_chunks, reader_waiting_);
+      next.sequence = sequence;
+      next.first_line = line;
+      next.lines.clear();
+      next.line_offsets.clear();
+      next.line_count = 0;
+      while (next.line_count < chunk_lines) {
+        const char *row = reader.next_line();
+        if (row == nullptr) {
+          break;
+        }
+        next.line_offsets.push_back(next.lines.size());
+        next.lines.append(row);
+        next.lines.push_back('\n');
+        ++next.line_count;
+      }
+      next.line_offsets.push_back(next.lines.size());
+      next.segment_count =
+          (next.line_count + kSegmentLines - 1) / kSegmentLines;
+      if (next.segments.size() < next.segment_count) {
+        next.segments.resize(next.segment_count);
+      }
+      next.remaining_segments.store(next.segment_count,
+                                    std::memory_order_relaxed);
+      line += next.line_count;
+      ++chunk_count_;
+      open_chunks_.fetch_add(1, std::memory_order_relaxed);
+      pending.push(&next);
+      signal_work();
+      if (next.line_count == 0) {
+        break;
+      }
+    }
+    line_count_ = line;
+    // NOTE the end of the input, the parser threads exit once all chunks
+    //      have been parsed.
+    pending.push(nullptr);
+    signal_work();
+  }
+
+  // NOTE the first chunks have kInitialChunkSegments segments, later ones
+  //      are sized by the average parse time per line so far.
+  auto next_chunk_lines() const -> std::uint64_t {
+    const std::uint64_t lines = parsed_lines_.load(std::memory_order_relaxed);
+    const std::uint64_t nanos = parse_nanos_.load(std::memory_order_relaxed);
+    std::uint64_t segments = kInitialChunkSegments;
+    if (lines > 0 && nanos > 0) {
+      segments = kChunkTime.count() * lines / nanos / kSegmentLines;
+    }
+    return std::clamp<std::uint64_t>(segments, 1, kMaxChunkSegments) *
+           kSegmentLines;
+  }
+
+  // NOTE parser threads first work off their own deque, then steal from the
+  //      others and only then take new chunks, i.e., chunks are finished
+  //      (and handed to the writer) roughly in order.
+  auto run(const std::string &filename, unsigned thread,
+           utils::mpmc_ring<chunk *> &pending,
+           std::vector<std::atomic<chunk *>> &parsed) -> void {
+    worker &self = workers_[thread];
+    for (;;) {
+      const std::uint64_t epoch = work_epoch_.load(std::memory_order_acquire);
+      std::optional<task> next = self.tasks.pop();
+      if (!next.has_value()) {
+        next = steal(thread);
+      }
+      if (!next.has_value()) {
+        if (const std::optional<chunk *> rows = pending.try_pop();
+            rows.has_value()) {
+          if (*rows == nullptr) {
+            input_done_.store(true, std::memory_order_release);
+            signal_work();
+            continue;
+          }
+          next = task{.rows = *rows, .begin = 0, .end = (*rows)->segment_count};
+        }
+      }
+      if (next.has_value()) {
+        parse_task(filename, thread, *next, parsed);
+        continue;
+      }
+      if (input_done_.load(std::memory_order_acquire) &&
+          open_chunks_.load(std::memory_order_acquire) == 0) {
+        return;
+      }
+      const clock::time_point start = clock::now();
+      idle_workers_.fetch_add(1, std::memory_order_relaxed);
+      work_epoch_.wait(epoch, std::memory_order_acquire);
+      idle_workers_.fetch_sub(1, std::memory_order_relaxed);
+      self.waiting += clock::now() - start;
+    }
+  }
+
+  auto steal(unsigned thread) -> std::optional<task> {
+    for (std::uint64_t offset = 1; offset < workers_.size(); ++offset) {
+      worker &victim = workers_[(thread + offset) % workers_.size()];
+      if (std::optional<task> stolen = victim.tasks.steal();
+          stolen.has_value()) {
+        ++workers_[thread].steal_count;
+        return stolen;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // NOTE while other parser threads are idle, the upper half of the
+  //      remaining segments is split off for them to steal, i.e., long
+  //      chunks (e.g., the last one) are shared on demand.
+  auto parse_task(const std::string &filename, unsigned thread, task next,
+                  std::vector<std::atomic<chunk *>> &parsed) -> void {
+    worker &self = workers_[thread];
+    chunk &rows = *next.rows;
+    for (std::uint64_t index = next.begin; index < next.end; ++index) {
+      if (next.end - index >= 2 &&
+          idle_workers_.load(std::memory_order_relaxed) > 0) {
+        const std::uint64_t middle = index + (next.end - index) / 2;
+        if (self.tasks.push(
+                task{.rows = &rows, .begin = middle, .end = next.end})) {
+          next.end = middle;
+          ++self.split_count;
+          signal_work();
+        }
+      }
+      const clock::time_point start = clock::now();
+      parse_segment(filename, rows, index, parsers_[thread]);
+      parse_nanos_.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                               start)
+              .count(),
+          std::memory_order_relaxed);
+    }
+    parsed_lines_.fetch_add(std::min(next.end * kSegmentLines,
+                                     rows.line_count) -
+                                std::min(next.begin * kSegmentLines,
+                                         rows.line_count),
+                            std::memory_order_relaxed);
+    const std::uint64_t segment_count = next.end - next.begin;
+    if (rows.remaining_segments.fetch_sub(segment_count,
+                                          std::memory_order_acq_rel) ==
+        segment_count) {
+      std::atomic<chunk *> &slot = parsed[rows.sequence % parsed.size()];
+      slot.store(&rows, std::memory_order_release);
+      slot.notify_one();
+      open_chunks_.fetch_sub(1, std::memory_order_release);
+      signal_work();
+    }
+  }
+
+  // NOTE see wikidata_parser_impl::parse, the lines are tokenized by the
+  //      same reader and entity boundaries within the segment are recorded
+  //      in its block.
+  static auto parse_segment(const std::string &filename, chunk &rows,
+                            std::uint64_t index, parser &datavalue_parser)
+      -> void {
+    segment &target = rows.segments[index];
+    target.rows.clear();
+    target.quarantined.clear();
+    target.first_entity_id.clear();
+    target.last_entity_id.clear();
+    const std::uint64_t begin = index * kSegmentLines;
+    const std::uint64_t end = std::min(begin + kSegmentLines, rows.line_count);
+    csv_reader reader(filename, rows.lines.data() + rows.line_offsets[begin],
+                      rows.lines.data() + rows.line_offsets[end]);
+    // NOTE a segment has at most kCapacity rows, i.e., its reader is
+    //      exhausted once the block is full.
+    for (std::uint64_t line = rows.first_line + begin + 1;
+         !target.rows.full(); ++line) {
+      columns_type &columns = target.rows.next_columns();
+      try {
+        if (!columns.read_row(reader)) {
+          break;
+        }
+      } catch (const io::error::base &error) {
+        // NOTE see wikidata_parser_impl::read_next_row.
+        target.quarantined.push_back(
+            quarantined_row{.line = line, .reason = error.what()});
+        continue;
+      }
+      if constexpr (columns_type::template has_field<kEntityId>()) {
+        const wd_id_column &entity_id = columns.template get_field<kEntityId>();
+        if (entity_id != target.last_entity_id) {
+          if (target.last_entity_id.empty()) {
+            target.first_entity_id = entity_id;
+          } else {
+            target.rows.end_entity();
+          }
+          target.last_entity_id = entity_id;
+        }
+      }
+      try {
+        if (sequential_parser::has_value_snak(columns)) {
+          datavalue_parser.parse_row(&target.rows, columns);
+        } else {
+          datavalue_parser.parse_novalue_row(&target.rows, columns);
+        }
+      } catch (const wd_parse_error &error) {
+        target.quarantined.push_back(quarantined_row{
+            .line = line,
+            .reason = error.what(),
+            .datavalue_type = std::string(
+                columns.template get_field<kDatavalueType>().view()),
+            .datavalue_string =
+                columns.template get_field<kDatavalueString>()});
+      }
+    }
+  }
+
+  auto write(const std::string &filename, result_handler *handler,
+             utils::spsc_ring<chunk *> &free_chunks,
+             std::vector<std::atomic<chunk *>> &parsed) -> void {
+    utils::progress_indicator progress("parsing " + filename);
+    progress.start();
+    wd_id_column entity_id;
+    for (std::uint64_t sequence = 0;; ++sequence) {
+      chunk &rows = wait_parsed(parsed[sequence % parsed.size()]);
+      if (rows.line_count == 0) {
+        break;
+      }
+      for (std::uint64_t index = 0; index < rows.segment_count; ++index) {
+        const segment &source = rows.segments[index];
+        // NOTE the entity of the previous segment ends where this one
+        //      begins.
+        if (!entity_id.empty() && !source.first_entity_id.empty() &&
+            source.first_entity_id != entity_id) {
+          handler->end_entity();
+        }
+        if (!source.rows.empty()) {
+          handle_block(*handler, source.rows);
+        }
+        for (const quarantined_row &row : source.quarantined) {
+          quarantine_.add(row.line, row.line, row.reason, row.datavalue_type,
+                          row.datavalue_string);
+        }
+        if (!source.last_entity_id.empty()) {
+          entity_id = source.last_entity_id;
+        }
+      }
+      for (std::uint64_t line = 0; line < rows.line_count; ++line) {
+        progress.update();
+      }
+      free_chunks.push(&rows);
+    }
+    if (!entity_id.empty()) {
+      handler->end_entity();
+    }
+    progress.done();
+  }
+
+  auto wait_parsed(std::atomic<chunk *> &slot) -> chunk & {
+    const clock::time_point start = clock::now();
+    chunk *rows = slot.load(std::memory_order_acquire);
+    for (; rows == nullptr; rows = slot.load(std::memory_order_acquire)) {
+      slot.wait(nullptr, std::memory_order_acquire);
+    }
+    slot.store(nullptr, std::memory_order_relaxed);
+    writer_waiting_ += clock::now() - start;
+    return *rows;
+  }
+
+  // NOTE pops from ring and adds the time spent blocked to waiting.
+  template <typename ring_type>
+  static auto take(ring_type &ring, clock::duration &waiting) {
+    const clock::time_point start = clock::now();
+    auto next = ring.pop();
+    waiting += clock::now() - start;
+    return next;
+  }
+
+  // NOTE wakes the idle parser threads to look for work (or to exit).
+  auto signal_work() -> void {
+    work_epoch_.fetch_add(1, std::memory_order_release);
+    work_epoch_.notify_all();
+  }
+
+  auto busy_percent(clock::duration waiting, std::uint64_t threads) const
+      -> std::uint64_t {
+    const double total = static_cast<double>(elapsed_.count()) * threads;
+    return total == 0 ? 0 : 100 * (1.0 - waiting.count() / total);
+  }
+
+  std::vector<parser> parsers_;
+  std::vector<worker> workers_;
+  utils::quarantine quarantine_;
+
+  std::atomic<std::uint64_t> work_epoch_{0}, idle_workers_{0};
+  std::atomic<std::uint64_t> open_chunks_{0};
+  std::atomic<bool> input_done_{false};
+  // NOTE the parse time so far, which determines the size of new chunks.
+  std::atomic<std::uint64_t> parsed_lines_{0}, parse_nanos_{0};
+
+  std::uint64_t chunk_count_ = 0, line_count_ = 0;
+  clock::duration elapsed_{}, reader_waiting_{}, writer_waiting_{};
+};
+} // namespace wd_migrate::detail
+
+#endif // !PARSER_PARALLEL_PARSER_H
@@ -0,0 +1,222 @@
+#ifndef PARSER_SNAPSHOT_PARSER_H
+#define PARSER_SNAPSHOT_PARSER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../handler/row_block.h"
+#include "../utils/checkpoint.h"
+#include "../utils/progress_indicator.h"
+#include "../utils/snapshot_file.h"
+#include "parallel_parser.h"
+#include "wikidata_columns.h"
+#include "wikidata_parser.h"
+#include "wikidata_snapshot.h"
+
+namespace wd_migrate {
+namespace detail {
+// Hands the stored columns of a single snapshot row to wd_column_pack.
+// NOTE columns that are not stored (e.g., datavalue_string) can only be
+//      projected out, see snapshot_parser_impl.
+template <typename tag> class snapshot_row_source {
+public:
+  snapshot_row_source(const utils::snapshot_file &file) : claim_ids_(file) {
+    snapshot_columns_t<tag>::for_each([&]<const char *column_name>() {
+      if constexpr (kSnapshotColumnStored<column_name>) {
+        columns_.emplace_back(column_name,
+                              utils::snapshot_column_reader(
+                                  file, column_name,
+                                  snapshot_encoding_of(column_name)));
+      }
+    });
+  }
+
+  auto read(const char *column_name, std::string &target) const -> void {
+    target = column(column_name).view(row_);
+  }
+  auto read(const char *column_name, std::uint64_t &target) const -> void {
+    target = column(column_name).scalar(row_);
+  }
+  // NOTE decoded and skipped columns point into the mapped snapshot, skipped
+  //      integer columns are never dereferenced.
+  // NOTE the claim_id is rendered from its key, it points into claim_id_
+  //      until the next row is read.
+  auto read(const char *column_name, const char *&target) const -> void {
+    if (column_name == kClaimId) {
+      claim_id_.clear();
+      claim_ids_.append(row_, claim_id_);
+      target = claim_id_.c_str();
+      return;
+    }
+    target = (stored(column_name) && column(column_name).has_strings())
+                 ? column(column_name).c_str(row_)
+                 : "";
+  }
+
+  auto seek(std::uint64_t row) -> void { row_ = row; }
+
+private:
+  auto stored(const char *column_name) const -> bool {
+    for (const auto &[name, _] : columns_) {
+      if (name == column_name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto column(const char *column_name) const
+      -> const utils::snapshot_column_reader & {
+    for (const auto &[name, reader] : columns_) {
+      if (name == column_name) {
+        return reader;
+      }
+    }
+    std::cerr << "Column not stored in snapshot: " << column_name << std::endl;
+    std::exit(-1);
+  }
+
+  std::vector<std::pair<const char *, utils::snapshot_column_reader>> columns_;
+  snapshot_claim_id_reader claim_ids_;
+  mutable std::string claim_id_;
+  std::uint64_t row_ = 0;
+};
+
+// Replays the rows of a snapshot (see snapshot_handler) into a result
+// handler, without tokenizing or parsing any datavalue.
+template <typename tag, typename result_handler> class snapshot_parser_impl {
+  using requested_columns =
+      wd_column_set_union_t<wd_column_set<kEntityId>,
+                            typename result_handler::used_columns>;
+  using columns_type = columns_info_t<
+      tag, wd_column_set_intersection<snapshot_columns_t<tag>,
+                                      requested_columns>>;
+
+public:
+  auto parse(const std::string &filename, result_handler *handler,
+             const utils::checkpoint_options &checkpoint = {}) -> void {
+    const utils::snapshot_file file(filename);
+    if (file.tag() != kSnapshotTag<tag>) {
+      std::cerr << "Snapshot does not match the input type: " << filename
+                << std::endl;
+      std::exit(-1);
+    }
+    snapshot_row_source<tag> source(file);
+    snapshot_value_reader values(file);
+    utils::input_checkpointer checkpointer(checkpoint, filename);
+    // NOTE the position of a checkpoint is the number of rows handled.
+    const std::uint64_t first_row = checkpointer.resume(*handler);
+    values.seek(first_row);
+    utils::progress_indicator progress("replaying " + filename);
+    progress.start();
+    for (std::uint64_t row = first_row; row < file.row_count(); ++row) {
+      source.seek(row);
+      columns_type &columns = block_.next_columns();
+      columns.fill_row(source);
+      update_entity(handler, checkpointer, columns, row);
+      std::visit([&](const auto &value) { block_.handle(columns, value); },
+                 values.read(row));
+      if (block_.full()) {
+        flush_block(handler);
+      }
+      progress.update();
+    }
+    if (!entity_id_.empty()) {
+      block_.end_entity();
+    }
+    flush_block(handler);
+    progress.done();
+    row_count_ = file.row_count();
+  }
+
+  auto summary() -> void {
+    std::cout << "snapshot: replayed " << row_count_ << " rows" << std::endl;
+  }
+
+private:
+  // NOTE see wikidata_parser_impl::update_entity.
+  auto update_entity(result_handler *handler,
+                     utils::input_checkpointer &checkpointer,
+                     const columns_type &columns, std::uint64_t position)
+      -> void {
+    if constexpr (columns_type::template has_field<kEntityId>()) {
+      const wd_id_column &entity_id = columns.template get_field<kEntityId>();
+      if (entity_id != entity_id_) {
+        if (!entity_id_.empty()) {
+          block_.end_entity();
+          if (checkpointer.due()) {
+            flush_block(handler);
+            checkpointer.save(position, *handler);
+          }
+        }
+        entity_id_ = entity_id;
+      }
+    } else if (checkpointer.due()) {
+      flush_block(handler);
+      checkpointer.save(position, *handler);
+    }
+  }
+
+  // NOTE see wikidata_parser_impl::flush_block.
+  auto flush_block(result_handler *handler) -> void {
+    if (!block_.empty()) {
+      handle_block(*handler, block_);
+      block_.clear();
+    }
+  }
+
+  row_block<columns_type> block_;
+  wd_id_column entity_id_;
+  std::uint64_t row_count_ = 0;
+};
+
+// Reads either a TSV dump or a snapshot, depending on the file's magic.
+template <typename tag, typename result_handler> class wikidata_input_parser {
+public:
+  // NOTE snapshots only contain parsed rows, so nothing is quarantined.
+  // NOTE TSV dumps are parsed on parse_threads threads (if any), which does
+  //      not support checkpoints.
+  auto parse(const std::string &filename, result_handler *handler,
+             const utils::checkpoint_options &checkpoint = {},
+             const utils::quarantine_options &quarantine = {},
+             unsigned parse_threads = 0) -> void {
+    from_snapshot_ = utils::snapshot_file::is_snapshot(filename);
+    parallel_ = !from_snapshot_ && parse_threads > 0;
+    if (from_snapshot_) {
+      snapshot_parser_.parse(filename, handler, checkpoint);
+    } else if (parallel_) {
+      parallel_parser_.parse(filename, handler, parse_threads, quarantine);
+    } else {
+      parser_.parse(filename, handler, checkpoint, quarantine);
+    }
+  }
+
+  auto summary() -> void {
+    if (from_snapshot_) {
+      snapshot_parser_.summary();
+    } else if (parallel_) {
+      parallel_parser_.summary();
+    } else {
+      parser_.summary();
+    }
+  }
+
+private:
+  bool from_snapshot_ = false, parallel_ = false;
+  wikidata_parser_impl<tag, result_handler> parser_;
+  parallel_parser_impl<tag, result_handler> parallel_parser_;
+  snapshot_parser_impl<tag, result_handler> snapshot_parser_;
+};
+} // namespace detail
+
+template <typename tag, typename result_handler>
+using wikidata_input_parser =
+    detail::wikidata_input_parser<tag, result_handler>;
+} // namespace wd_migrate
+
+#endif // !PARSER_SNAPSHOT_PARSER_H
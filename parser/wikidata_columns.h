@@ -1,12 +1,18 @@
 #ifndef PARSER_WIKIDATAUMNS_H
 #define PARSER_WIKIDATAUMNS_H
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
 
 #include "../utils/date.h"
+#include "wikidata_ids.h"
 
 namespace wd_migrate {
 struct claims_tag_t {};
@@ -18,8 +24,11 @@ struct wd_string_t {
   const std::string value;
 };
 
+// NOTE id is the tagged id of value (see encode_entity_id), or kNoEntityId
+//      if value is not of the form <letter><number>.
 struct wd_entity_id_t {
   const std::string value;
+  const std::uint64_t id = kNoEntityId;
 };
 
 struct wd_text_t {
@@ -76,28 +85,320 @@ struct wd_coordinate_t {
   const std::string globe;
 };
 
+// NOTE the original text is kept, key is std::nullopt if the claim_id is not
+//      of the canonical form <entity>$<UUID>.
+struct wd_claim_id_t {
+  std::string value;
+  std::optional<wd_claim_key_t> key;
+
+  auto decode(const char *raw) -> void {
+    value = raw;
+    key = decode_claim_id(value);
+  }
+};
+
 template <typename type> struct wd_novalue_t {};
 template <typename type> struct wd_invalid_t : public wd_novalue_t<type> {};
 
+// NOTE any value a parser can hand to a result handler.
+using wd_value_t =
+    std::variant<wd_string_t, wd_entity_id_t, wd_text_t, wd_time_t,
+                 wd_quantity_t, wd_coordinate_t, wd_novalue_t<wd_string_t>,
+                 wd_novalue_t<wd_entity_id_t>, wd_novalue_t<wd_text_t>,
+                 wd_novalue_t<wd_time_t>, wd_novalue_t<wd_quantity_t>,
+                 wd_novalue_t<wd_coordinate_t>, wd_invalid_t<wd_string_t>,
+                 wd_invalid_t<wd_entity_id_t>, wd_invalid_t<wd_text_t>,
+                 wd_invalid_t<wd_time_t>, wd_invalid_t<wd_quantity_t>,
+                 wd_invalid_t<wd_coordinate_t>>;
+
+// NOTE the textual form of a value used by lookups and queries, e.g., Q5,
+//      +1.5 Q11573 or text@en (std::nullopt for novalue/invalid values).
+inline auto render_value(const wd_value_t &value)
+    -> std::optional<std::string> {
+  return std::visit(
+      [](const auto &result) -> std::optional<std::string> {
+        using result_type = std::decay_t<decltype(result)>;
+        if constexpr (std::is_same_v<result_type, wd_string_t>) {
+          return result.value;
+        } else if constexpr (std::is_same_v<result_type, wd_entity_id_t>) {
+          return result.value;
+        } else if constexpr (std::is_same_v<result_type, wd_text_t>) {
+          return result.text + "@" + result.language;
+        } else if constexpr (std::is_same_v<result_type, wd_time_t>) {
+          return result.time;
+        } else if constexpr (std::is_same_v<result_type, wd_quantity_t>) {
+          return result.unit.has_value()
+                     ? result.quantity + " " + *result.unit
+                     : result.quantity;
+        } else if constexpr (std::is_same_v<result_type, wd_coordinate_t>) {
+          return result.latitude + "," + result.longitude;
+        } else {
+          return std::nullopt;
+        }
+      },
+      value);
+}
+
 namespace detail {
-template <const char *column_name, typename column_type> struct wd_column_info {
+// NOTE the kind of a value is its index in wd_value_t.
+template <typename type, typename variant> struct variant_index;
+template <typename type, typename... types>
+struct variant_index<type, std::variant<types...>> {
+  static constexpr std::uint64_t value = []() {
+    std::uint64_t index = 0;
+    ((std::is_same_v<type, types> ? false : (++index, true)) && ...);
+    return index;
+  }();
+};
+template <typename type>
+static constexpr std::uint64_t kValueKind =
+    variant_index<type, wd_value_t>::value;
+
+// NOTE column types the reader cannot convert to are read as raw text and
+//      decoded once the row has been tokenized.
+template <typename column_type>
+concept wd_decoded_column = requires(column_type &data, const char *raw) {
+  data.decode(raw);
+};
+
+// Column with a closed set of known values (e.g., the rank), stored as the
+// index of the value in values::kValues.
+// NOTE other values are kept as text (see view()), i.e., values added to the
+//      dump later on (e.g., a new datatype) are passed through unchanged.
+template <typename values> class wd_enum_column {
+public:
+  static constexpr std::uint8_t kUnknown = 0xFF;
+  static_assert(values::kValues.size() < kUnknown);
+
+  // NOTE the code of a known value, e.g., to compare against in a constant
+  //      expression (kUnknown for other values).
+  static constexpr auto code_of(std::string_view value) -> std::uint8_t {
+    for (std::uint8_t code = 0; code < values::kValues.size(); ++code) {
+      if (values::kValues[code] == value) {
+        return code;
+      }
+    }
+    return kUnknown;
+  }
+
+  auto decode(const char *raw) -> void {
+    code_ = code_of(raw);
+    if (code_ == kUnknown) {
+      unknown_ = raw;
+    }
+  }
+
+  auto code() const -> std::uint8_t { return code_; }
+
+  auto view() const -> std::string_view {
+    return code_ == kUnknown ? std::string_view(unknown_)
+                             : values::kValues[code_];
+  }
+  operator std::string_view() const { return view(); }
+
+  friend auto operator==(const wd_enum_column &column,
+                         std::string_view value) -> bool {
+    return column.view() == value;
+  }
+  friend auto operator<<(std::ostream &os, const wd_enum_column &column)
+      -> std::ostream & {
+    return os << column.view();
+  }
+
+private:
+  std::uint8_t code_ = kUnknown;
+  std::string unknown_;
+};
+
+struct wd_claims_type_values {
+  static constexpr std::array<std::string_view, 2> kValues = {"statement",
+                                                              "claim"};
+};
+using wd_claims_type_column = wd_enum_column<wd_claims_type_values>;
+
+struct wd_rank_values {
+  static constexpr std::array<std::string_view, 3> kValues = {
+      "normal", "preferred", "deprecated"};
+};
+using wd_rank_column = wd_enum_column<wd_rank_values>;
+
+struct wd_snaktype_values {
+  static constexpr std::array<std::string_view, 3> kValues = {
+      "value", "somevalue", "novalue"};
+};
+using wd_snaktype_column = wd_enum_column<wd_snaktype_values>;
+
+struct wd_datavalue_type_values {
+  static constexpr std::array<std::string_view, 6> kValues = {
+      "string",   "wikibase-entityid", "monolingualtext",
+      "time",     "quantity",          "globecoordinate"};
+};
+using wd_datavalue_type_column = wd_enum_column<wd_datavalue_type_values>;
+
+struct wd_datatype_values {
+  static constexpr std::array<std::string_view, 18> kValues = {
+      "wikibase-item",     "external-id",      "string",
+      "quantity",          "time",             "monolingualtext",
+      "globe-coordinate",  "commonsMedia",     "url",
+      "wikibase-property", "math",             "geo-shape",
+      "tabular-data",      "musical-notation", "wikibase-lexeme",
+      "wikibase-form",     "wikibase-sense",   "entity-schema"};
+};
+using wd_datatype_column = wd_enum_column<wd_datatype_values>;
+
+// NOTE the calendarmodel of time values (see wd_time_t) is not a column, but
+//      is encoded with the same codes for integer time output.
+struct wd_calendar_model_values {
+  static constexpr std::array<std::string_view, 2> kValues = {"Q1985727",
+                                                              "Q1985786"};
+};
+using wd_calendar_model = wd_enum_column<wd_calendar_model_values>;
+
+// Column of ids of the form <letter><number> (e.g., Q42 or P31), decoded to
+// their tagged id (see encode_entity_id) while the row is read. Comparing
+// and hashing them are integer operations, output renders the id again.
+// NOTE other values (e.g., L1-F1 or empty values) are kept as text.
+class wd_id_column {
+public:
+  auto decode(const char *raw) -> void {
+    const std::string_view value(raw);
+    id_ = encode_entity_id(value).value_or(kNoEntityId);
+    if (id_ == kNoEntityId) {
+      text_.assign(value);
+    } else {
+      text_.clear();
+    }
+  }
+
+  // NOTE kNoEntityId for values that are not ids.
+  auto id() const -> std::uint64_t { return id_; }
+  auto empty() const -> bool { return id_ == kNoEntityId && text_.empty(); }
+  auto clear() -> void {
+    id_ = kNoEntityId;
+    text_.clear();
+  }
+
+  // NOTE ids are rendered into buffer, other values point into the column.
+  auto view(wd_entity_id_buffer &buffer) const -> std::string_view {
+    return id_ == kNoEntityId ? std::string_view(text_)
+                              : format_entity_id(id_, buffer);
+  }
+  auto str() const -> std::string {
+    wd_entity_id_buffer buffer;
+    return std::string(view(buffer));
+  }
+
+  friend auto operator==(const wd_id_column &lhs, const wd_id_column &rhs)
+      -> bool {
+    return lhs.id_ == rhs.id_ && lhs.text_ == rhs.text_;
+  }
+  template <typename ostream>
+  friend auto operator<<(ostream &os, const wd_id_column &column)
+      -> ostream & {
+    wd_entity_id_buffer buffer;
+    os << column.view(buffer);
+    return os;
+  }
+
+  struct hash {
+    auto operator()(const wd_id_column &column) const -> std::size_t {
+      return column.id_ != kNoEntityId
+                 ? std::hash<std::uint64_t>{}(column.id_)
+                 : std::hash<std::string>{}(column.text_);
+    }
+  };
+
+private:
+  std::uint64_t id_ = kNoEntityId;
+  std::string text_;
+};
+
+template <const char *column_name, typename column_type,
+          bool skipped = false>
+struct wd_column_info {
 public:
+  static constexpr const char *kName = column_name;
+  static constexpr bool kSkipped = skipped;
+
   template <const char *field_name> static constexpr auto is_named() {
     return column_name == field_name;
   }
 
+  auto read_target() -> auto & {
+    if constexpr (wd_decoded_column<column_type>) {
+      return raw_;
+    } else {
+      return data_;
+    }
+  }
+
+  auto decode() -> void {
+    if constexpr (wd_decoded_column<column_type>) {
+      data_.decode(raw_);
+    }
+  }
+
   column_type data_;
+  [[no_unique_address]] std::conditional_t<wd_decoded_column<column_type>,
+                                           const char *, std::monostate>
+      raw_;
 };
 
+// NOTE a skipped column is still tokenized by the reader, but we only keep a
+//      pointer into the line buffer instead of copying or converting it.
+template <const char *column_name>
+using wd_skipped_column_info =
+    wd_column_info<column_name, const char *, /*skipped=*/true>;
+
+template <const char *...column_names> struct wd_column_set {
+  template <const char *column_name> static constexpr auto contains() -> bool {
+    return ((column_name == column_names) || ...);
+  }
+
+  // NOTE calls fn.template operator()<column_name>() for every column.
+  template <typename column_fn> static auto for_each(column_fn &&fn) -> void {
+    (fn.template operator()<column_names>(), ...);
+  }
+};
+
+template <typename lhs, typename rhs> struct wd_column_set_union;
+template <const char *...lhs, const char *...rhs>
+struct wd_column_set_union<wd_column_set<lhs...>, wd_column_set<rhs...>> {
+  using type = wd_column_set<lhs..., rhs...>;
+};
+template <typename lhs, typename rhs>
+using wd_column_set_union_t = typename wd_column_set_union<lhs, rhs>::type;
+
+template <typename lhs, typename rhs> struct wd_column_set_intersection {
+  template <const char *column_name> static constexpr auto contains() -> bool {
+    return lhs::template contains<column_name>() &&
+           rhs::template contains<column_name>();
+  }
+};
+
+template <typename used_columns, typename column>
+using wd_projected_column_t =
+    std::conditional_t<used_columns::template contains<column::kName>(),
+                       column, wd_skipped_column_info<column::kName>>;
+
 template <typename... columns> struct wd_column_pack;
 
 template <> struct wd_column_pack<> {
   static constexpr auto size() -> std::uint64_t { return 0; }
 
+  template <const char *field_name> static constexpr auto has_field() {
+    return false;
+  }
+
   template <typename reader_type, typename... column_types>
-  auto read_row(reader_type &reader, column_types &&...columns) -> bool {
+  auto read_columns(reader_type &reader, column_types &&...columns) -> bool {
     return reader.read_row(std::forward<column_types>(columns)...);
   }
+
+  auto decode_columns() -> void {}
+
+  template <typename source_type>
+  auto fill_columns(source_type &source) -> void {}
 };
 
 template <typename head, typename... tail>
@@ -106,18 +407,51 @@ struct wd_column_pack<head, tail...> {
     return 1 + decltype(tail_)::size();
   }
 
+  template <const char *field_name> static constexpr auto has_field() {
+    return head::template is_named<field_name>() ||
+           decltype(tail_)::template has_field<field_name>();
+  }
+
   template <const char *field_name> const auto &get_field() const {
     if constexpr (head::template is_named<field_name>()) {
+      static_assert(!head::kSkipped,
+                    "column is projected out, add it to used_columns.");
       return head_.data_;
     } else {
       return tail_.template get_field<field_name>();
     }
   }
 
+  template <typename reader_type> auto read_row(reader_type &reader) -> bool {
+    if (!read_columns(reader)) {
+      return false;
+    }
+    decode_columns();
+    return true;
+  }
+
   template <typename reader_type, typename... column_types>
-  auto read_row(reader_type &reader, column_types &&...columns) -> bool {
-    return tail_.read_row(reader, std::forward<column_types>(columns)...,
-                          head_.data_);
+  auto read_columns(reader_type &reader, column_types &&...columns) -> bool {
+    return tail_.read_columns(reader, std::forward<column_types>(columns)...,
+                              head_.read_target());
+  }
+
+  auto decode_columns() -> void {
+    head_.decode();
+    tail_.decode_columns();
+  }
+
+  // NOTE reads the columns by name via source.read(name, target), e.g., from
+  //      a snapshot, instead of tokenizing a line.
+  template <typename source_type> auto fill_row(source_type &source) -> void {
+    fill_columns(source);
+    decode_columns();
+  }
+
+  template <typename source_type>
+  auto fill_columns(source_type &source) -> void {
+    source.read(head::kName, head_.read_target());
+    tail_.fill_columns(source);
   }
 
 private:
@@ -126,34 +460,35 @@ private:
 };
 
 static const char kEntityId[] = "entity_id";
-using col_entity_id = wd_column_info<kEntityId, std::string>;
+using col_entity_id = wd_column_info<kEntityId, wd_id_column>;
 
 static const char kClaimsType[] = "type";
-using col_claims_type = wd_column_info<kClaimsType, std::string>;
+using col_claims_type = wd_column_info<kClaimsType, wd_claims_type_column>;
 
 static const char kClaimsRank[] = "rank";
-using col_claims_rank = wd_column_info<kClaimsRank, std::string>;
+using col_claims_rank = wd_column_info<kClaimsRank, wd_rank_column>;
 
 static const char kClaimId[] = "claim_id";
-using col_claims_id = wd_column_info<kClaimId, std::string>;
+using col_claims_id = wd_column_info<kClaimId, wd_claim_id_t>;
 
 static const char kPropety[] = "property";
-using col_property = wd_column_info<kPropety, std::string>;
+using col_property = wd_column_info<kPropety, wd_id_column>;
 
 static const char kHash[] = "hash";
 using col_hash = wd_column_info<kHash, std::string>;
 
 static const char kSnaktype[] = "snaktype";
-using col_snaktype = wd_column_info<kSnaktype, std::string>;
+using col_snaktype = wd_column_info<kSnaktype, wd_snaktype_column>;
 
 static const char kQualifierProperty[] = "qualifier_property";
-using col_qualifier_property = wd_column_info<kQualifierProperty, std::string>;
+using col_qualifier_property =
+    wd_column_info<kQualifierProperty, wd_id_column>;
 
 static const char kDatavalueString[] = "datavalue_string";
 using col_datavalue_string = wd_column_info<kDatavalueString, std::string>;
 
 static const char kDatavalueEntity[] = "datavalue_entity";
-using col_datavalue_entity = wd_column_info<kDatavalueEntity, std::string>;
+using col_datavalue_entity = wd_column_info<kDatavalueEntity, wd_id_column>;
 
 static const char kDatavalueDate[] = "datavalue_date";
 using col_datavalue_date = wd_column_info<kDatavalueDate, std::string>;
@@ -162,10 +497,11 @@ static const char kNil[] = "nil";
 using col_nil = wd_column_info<kNil, std::string>;
 
 static const char kDatavalueType[] = "datavalue_type";
-using col_datavalue_type = wd_column_info<kDatavalueType, std::string>;
+using col_datavalue_type =
+    wd_column_info<kDatavalueType, wd_datavalue_type_column>;
 
 static const char kDatatype[] = "datatype";
-using col_datatype = wd_column_info<kDatatype, std::string>;
+using col_datatype = wd_column_info<kDatatype, wd_datatype_column>;
 
 static const char kCounter[] = "counter";
 using col_counter = wd_column_info<kCounter, std::uint64_t>;
@@ -173,22 +509,29 @@ using col_counter = wd_column_info<kCounter, std::uint64_t>;
 static const char kOrderHash[] = "order_hash";
 using col_order_hash = wd_column_info<kOrderHash, std::uint64_t>;
 
-template <typename tag> struct columns_info;
-template <> struct columns_info<claims_tag_t> {
-  using type =
-      wd_column_pack<col_entity_id, col_claims_id, col_claims_type,
-                     col_claims_rank, col_snaktype, col_property,
-                     col_datavalue_string, col_datavalue_entity,
-                     col_datavalue_date, col_datavalue_type, col_datatype>;
-};
-template <> struct columns_info<qualifiers_tag_t> {
-  using type = wd_column_pack<col_claims_id, col_property, col_hash,
-                              col_snaktype, col_qualifier_property,
-                              col_datavalue_string, col_datavalue_entity,
-                              col_datavalue_date, col_nil, col_datavalue_type,
-                              col_datatype, col_counter, col_order_hash>;
-};
-template <typename tag> using columns_info_t = typename columns_info<tag>::type;
+template <typename used_columns, typename... columns>
+using wd_projected_column_pack =
+    wd_column_pack<wd_projected_column_t<used_columns, columns>...>;
+
+template <typename tag, typename used_columns> struct columns_info;
+template <typename used_columns>
+struct columns_info<claims_tag_t, used_columns> {
+  using type = wd_projected_column_pack<
+      used_columns, col_entity_id, col_claims_id, col_claims_type,
+      col_claims_rank, col_snaktype, col_property, col_datavalue_string,
+      col_datavalue_entity, col_datavalue_date, col_datavalue_type,
+      col_datatype>;
+};
+template <typename used_columns>
+struct columns_info<qualifiers_tag_t, used_columns> {
+  using type = wd_projected_column_pack<
+      used_columns, col_claims_id, col_property, col_hash, col_snaktype,
+      col_qualifier_property, col_datavalue_string, col_datavalue_entity,
+      col_datavalue_date, col_nil, col_datavalue_type, col_datatype,
+      col_counter, col_order_hash>;
+};
+template <typename tag, typename used_columns>
+using columns_info_t = typename columns_info<tag, used_columns>::type;
 } // namespace detail
 } // namespace wd_migrate
 
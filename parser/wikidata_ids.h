@@ -0,0 +1,250 @@
+#ifndef PARSER_WIKIDATA_IDS_H
+#define PARSER_WIKIDATA_IDS_H
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace wd_migrate {
+// Tagged entity ids store the prefix character in the upper 8 bits and the
+// number in the lower bits, e.g., Q42 is encoded as ('Q' << 56) | 42.
+// NOTE ids with leading zeros or other suffixes (e.g., L1-F1) are rejected,
+//      so the encoding is bijective.
+static constexpr std::uint64_t kEntityNumberBits = 55;
+static constexpr std::uint64_t kEntityNumberMask =
+    (std::uint64_t(1) << kEntityNumberBits) - 1;
+// NOTE tagged ids are never 0, i.e., 0 marks values that are not ids.
+static constexpr std::uint64_t kNoEntityId = 0;
+
+namespace detail {
+// NOTE checks 8 ASCII characters at once (SWAR), see parse_digits.
+inline auto is_eight_digits(std::uint64_t chunk) -> bool {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+          (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+// NOTE converts 8 ASCII digits (the first one in the lowest byte) with three
+//      multiplications instead of 8 dependent steps.
+inline auto parse_eight_digits(std::uint64_t chunk) -> std::uint64_t {
+  chunk -= 0x3030303030303030;
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & 0x000000FF000000FF) * 0x000F424000000064) +
+           (((chunk >> 16) & 0x000000FF000000FF) * 0x0000271000000001)) >>
+          32;
+  return static_cast<std::uint32_t>(chunk);
+}
+
+// Parses 1 to 16 decimal digits, 8 at a time (i.e., ids take one or two
+// steps). Returns std::nullopt if any character is not a digit.
+// NOTE the digits are right-aligned in a buffer padded with '0', so that no
+//      byte past the end of digits is read.
+inline auto parse_digits(const std::string_view digits)
+    -> std::optional<std::uint64_t> {
+  if constexpr (std::endian::native != std::endian::little) {
+    std::uint64_t number = 0;
+    for (const char digit : digits) {
+      if (digit < '0' || digit > '9') {
+        return std::nullopt;
+      }
+      number = 10 * number + (digit - '0');
+    }
+    return number;
+  } else {
+    char padded[16];
+    std::memset(padded, '0', sizeof(padded));
+    std::memcpy(padded + sizeof(padded) - digits.size(), digits.data(),
+                digits.size());
+    std::uint64_t hi, lo;
+    std::memcpy(&hi, padded, sizeof(hi));
+    std::memcpy(&lo, padded + sizeof(hi), sizeof(lo));
+    if (!is_eight_digits(hi) || !is_eight_digits(lo)) {
+      return std::nullopt;
+    }
+    return parse_eight_digits(hi) * 100000000 + parse_eight_digits(lo);
+  }
+}
+} // namespace detail
+
+inline auto encode_entity_id(const std::string_view id)
+    -> std::optional<std::uint64_t> {
+  if (id.size() < 2 || id.size() > 17 ||
+      !((id[0] >= 'A' && id[0] <= 'Z') || (id[0] >= 'a' && id[0] <= 'z')) ||
+      (id[1] == '0' && id.size() != 2)) {
+    return std::nullopt;
+  }
+  const std::optional<std::uint64_t> number =
+      detail::parse_digits(id.substr(1));
+  if (!number.has_value() || *number > kEntityNumberMask) {
+    return std::nullopt;
+  }
+  return (std::uint64_t(id[0]) << 56) | *number;
+}
+
+inline auto decode_entity_id(std::uint64_t id) -> std::string {
+  return static_cast<char>(id >> 56) +
+         std::to_string(id & kEntityNumberMask);
+}
+
+// NOTE large enough for the prefix and any number of kEntityNumberBits.
+using wd_entity_id_buffer = std::array<char, 20>;
+
+// Same as decode_entity_id, but renders the id into buffer instead of
+// allocating a string.
+inline auto format_entity_id(std::uint64_t id, wd_entity_id_buffer &buffer)
+    -> std::string_view {
+  buffer[0] = static_cast<char>(id >> 56);
+  const std::to_chars_result result =
+      std::to_chars(buffer.data() + 1, buffer.data() + buffer.size(),
+                    id & kEntityNumberMask);
+  return std::string_view(buffer.data(), result.ptr - buffer.data());
+}
+
+// claim_ids have the form <entity>$<UUID>, e.g.,
+// Q42$F078E5B3-F9A8-480E-B7AC-D97778CBBEF9. They are decoded into the tagged
+// entity id and the 128-bit UUID.
+// NOTE bit 55 of the entity marks UUIDs that are written in lowercase.
+struct wd_claim_key_t {
+  std::uint64_t entity;
+  std::uint64_t uuid_hi, uuid_lo;
+};
+
+static constexpr std::uint64_t kClaimKeyBytes = 24;
+static constexpr std::uint64_t kLowercaseUUIDFlag = std::uint64_t(1)
+                                                    << kEntityNumberBits;
+
+namespace detail {
+inline auto hex_digit(char c) -> int {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+inline auto append_hex(std::string &out, std::uint64_t value, int digits,
+                       bool lowercase = true) -> void {
+  const char *alphabet = lowercase ? "0123456789abcdef" : "0123456789ABCDEF";
+  for (int shift = 4 * (digits - 1); shift >= 0; shift -= 4) {
+    out.push_back(alphabet[(value >> shift) & 0xF]);
+  }
+}
+
+// NOTE dashes of the canonical UUID form 8-4-4-4-12.
+inline auto is_uuid_dash(std::uint64_t index) -> bool {
+  return index == 8 || index == 13 || index == 18 || index == 23;
+}
+} // namespace detail
+
+// NOTE returns std::nullopt for claim_ids that are not of the canonical form,
+//      these need to be kept as text.
+inline auto decode_claim_id(const std::string_view claim_id)
+    -> std::optional<wd_claim_key_t> {
+  const auto separator = claim_id.find('$');
+  if (separator == std::string_view::npos ||
+      claim_id.size() - separator - 1 != 36) {
+    return std::nullopt;
+  }
+  const std::optional<std::uint64_t> entity =
+      encode_entity_id(claim_id.substr(0, separator));
+  if (!entity.has_value()) {
+    return std::nullopt;
+  }
+  const std::string_view uuid = claim_id.substr(separator + 1);
+  std::uint64_t hi = 0, lo = 0, digits = 0;
+  bool has_lower = false, has_upper = false;
+  for (std::uint64_t index = 0; index < uuid.size(); ++index) {
+    if (detail::is_uuid_dash(index)) {
+      if (uuid[index] != '-') {
+        return std::nullopt;
+      }
+      continue;
+    }
+    const int digit = detail::hex_digit(uuid[index]);
+    if (digit < 0) {
+      return std::nullopt;
+    }
+    has_lower |= (uuid[index] >= 'a' && uuid[index] <= 'f');
+    has_upper |= (uuid[index] >= 'A' && uuid[index] <= 'F');
+    std::uint64_t &half = (digits < 16 ? hi : lo);
+    half = (half << 4) | digit;
+    ++digits;
+  }
+  if (has_lower && has_upper) {
+    return std::nullopt;
+  }
+  return wd_claim_key_t{.entity = *entity |
+                                  (has_lower ? kLowercaseUUIDFlag : 0),
+                        .uuid_hi = hi,
+                        .uuid_lo = lo};
+}
+
+// Appends the claim_id of a claim key to out (inverse of decode_claim_id).
+inline auto append_claim_id(std::string &out, const wd_claim_key_t &key)
+    -> void {
+  const bool lowercase = (key.entity & kLowercaseUUIDFlag) != 0;
+  wd_entity_id_buffer buffer;
+  out.append(format_entity_id(key.entity & ~kLowercaseUUIDFlag, buffer));
+  out.push_back('$');
+  // NOTE the UUID groups are 8-4-4-4-12 hex digits.
+  detail::append_hex(out, key.uuid_hi >> 32, 8, lowercase);
+  out.push_back('-');
+  detail::append_hex(out, key.uuid_hi >> 16, 4, lowercase);
+  out.push_back('-');
+  detail::append_hex(out, key.uuid_hi, 4, lowercase);
+  out.push_back('-');
+  detail::append_hex(out, key.uuid_lo >> 48, 4, lowercase);
+  out.push_back('-');
+  detail::append_hex(out, key.uuid_lo, 12, lowercase);
+}
+
+inline auto claim_key_to_string(const wd_claim_key_t &key) -> std::string {
+  std::string claim_id;
+  append_claim_id(claim_id, key);
+  return claim_id;
+}
+
+// Appends the fixed-width hex form of a claim key (16 + 32 digits) to out.
+inline auto append_claim_key_hex(std::string &out, const wd_claim_key_t &key)
+    -> void {
+  detail::append_hex(out, key.entity, 16);
+  detail::append_hex(out, key.uuid_hi, 16);
+  detail::append_hex(out, key.uuid_lo, 16);
+}
+
+// Fixed-width hex form of a claim key (16 + 32 digits).
+inline auto claim_key_to_hex(const wd_claim_key_t &key) -> std::string {
+  std::string hex;
+  hex.reserve(2 * kClaimKeyBytes);
+  append_claim_key_hex(hex, key);
+  return hex;
+}
+
+inline auto claim_key_from_hex(const std::string_view hex)
+    -> std::optional<wd_claim_key_t> {
+  if (hex.size() != 2 * kClaimKeyBytes) {
+    return std::nullopt;
+  }
+  std::uint64_t words[3] = {0, 0, 0};
+  for (std::uint64_t index = 0; index < hex.size(); ++index) {
+    const int digit = detail::hex_digit(hex[index]);
+    if (digit < 0) {
+      return std::nullopt;
+    }
+    words[index / 16] = (words[index / 16] << 4) | digit;
+  }
+  return wd_claim_key_t{
+      .entity = words[0], .uuid_hi = words[1], .uuid_lo = words[2]};
+}
+
+} // namespace wd_migrate
+
+#endif // !PARSER_WIKIDATA_IDS_H
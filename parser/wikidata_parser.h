@@ -1,27 +1,69 @@
 #ifndef PARSER_WIKIDATA_PARSER_H
 #define PARSER_WIKIDATA_PARSER_H
 
+#include <charconv>
 #include <cstdlib>
 #include <iostream>
+#include <memory_resource>
 #include <optional>
 #include <regex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include "../fast-cpp-csv-parser/csv.h"
+#include "../handler/row_block.h"
+#include "../utils/bounded_cache.h"
+#include "../utils/checkpoint.h"
 #include "../utils/progress_indicator.h"
+#include "../utils/quarantine.h"
 #include "wikidata_columns.h"
 
 namespace wd_migrate {
 namespace detail {
 
+// Thrown by the datavalue parsers for rows they cannot parse.
+// NOTE thrown before the row is handed to the handler.
+struct wd_parse_error : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// NOTE the scratch allocations of the datavalue parsers (e.g., match results)
+//      are served by the arena of the row_block they parse into, so they are
+//      released in bulk once the block has been handled.
+using wd_match =
+    std::match_results<std::string::const_iterator,
+                       std::pmr::polymorphic_allocator<std::ssub_match>>;
+using wd_istringstream =
+    std::basic_istringstream<char, std::char_traits<char>,
+                             std::pmr::polymorphic_allocator<char>>;
+
+// NOTE the regexes only match digits here, i.e., this only fails on overflow.
+inline auto parse_match_uint(const std::ssub_match &match) -> std::uint64_t {
+  const char *begin = &*match.first;
+  std::uint64_t value;
+  const auto [end, error] = std::from_chars(begin, begin + match.length(),
+                                            value);
+  if (error != std::errc() || end != begin + match.length()) {
+    throw wd_parse_error("unexpected integer");
+  }
+  return value;
+}
+
 template <typename derived> struct wd_datavalue_type_parser {
 public:
+  // NOTE compares the code of the datavalue_type column, see wd_enum_column.
   template <typename columns_type>
   static auto can_parse(const columns_type &columns) -> bool {
-    return derived::kTypeIdentifier ==
-           columns.template get_field<kDatavalueType>();
+    static constexpr std::uint8_t kTypeCode =
+        wd_datavalue_type_column::code_of(derived::kTypeIdentifier);
+    static_assert(kTypeCode != wd_datavalue_type_column::kUnknown);
+    return columns.template get_field<kDatavalueType>().code() == kTypeCode;
   }
+  auto summary() -> void {}
+  auto merge_stats(const derived &other) -> void {}
 };
 
 struct wd_fallback_parser {
@@ -33,17 +75,14 @@ public:
   template <typename result_handler, typename columns_type>
   static auto parse(result_handler *handler, const columns_type &columns)
       -> void {
-    std::cerr << "Unexpected datavalue_type encountered."
-              << std::string(20, ' ') << std::endl;
-    std::cerr << "datavalue_type: "
-              << columns.template get_field<kDatavalueType>() << std::endl;
-    std::exit(-1);
+    throw wd_parse_error("unexpected datavalue_type");
   }
 };
 
 struct wd_string_parser : public wd_datavalue_type_parser<wd_string_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "string";
+  static constexpr std::string_view kTypeIdentifier = "string";
+  using value_type = wd_string_t;
   template <typename result_handler, typename columns_type>
   static auto parse_row(result_handler *handler, const columns_type &columns)
       -> void {
@@ -60,28 +99,33 @@ public:
 
 struct wd_entity_parser : public wd_datavalue_type_parser<wd_entity_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "wikibase-entityid";
+  static constexpr std::string_view kTypeIdentifier = "wikibase-entityid";
+  using value_type = wd_entity_id_t;
   template <typename result_handler, typename columns_type>
   static auto parse_row(result_handler *handler, const columns_type &columns)
       -> void {
-    const std::string &entity_id =
+    const wd_id_column &entity =
         columns.template get_field<kDatavalueEntity>();
-    if (entity_id.size() == 0) {
+    if (entity.empty()) {
       handler->handle(columns, wd_novalue_t<wd_entity_id_t>{});
       return;
     }
+    wd_entity_id_buffer buffer;
+    const std::string_view entity_id = entity.view(buffer);
     if (entity_id.size() < 2 || (entity_id[0] != 'P' && entity_id[0] != 'Q')) {
       handler->handle(columns, wd_invalid_t<wd_entity_id_t>{});
       return;
     }
-    // NOTE "parsing" the entity_id is trivial.
-    handler->handle(columns, wd_entity_id_t{.value = entity_id});
+    // NOTE the id has already been decoded while reading the row.
+    handler->handle(columns, wd_entity_id_t{.value = std::string(entity_id),
+                                            .id = entity.id()});
   }
 };
 
 struct wd_text_parser : public wd_datavalue_type_parser<wd_text_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "monolingualtext";
+  static constexpr std::string_view kTypeIdentifier = "monolingualtext";
+  using value_type = wd_text_t;
   template <typename result_handler, typename columns_type>
   static auto parse_row(result_handler *handler, const columns_type &columns)
       -> void {
@@ -91,14 +135,12 @@ public:
       handler->handle(columns, wd_novalue_t<wd_text_t>{});
       return;
     }
-    std::smatch text_match;
+    wd_match text_match(&handler->arena());
     if (!std::regex_match(text_str, text_match, text_regex)) {
-      std::cerr << "Unexpected text string encountered." << std::endl;
-      std::cerr << "text_str: " << text_str << std::endl;
-      std::exit(-1);
+      throw wd_parse_error("unexpected text string");
     }
-    std::string text(text_match[1].str()), language(text_match[2].str());
-    handler->handle(columns, wd_text_t{.text = text, .language = language});
+    handler->handle(columns, wd_text_t{.text = text_match[1].str(),
+                                       .language = text_match[2].str()});
   }
 
 private:
@@ -108,45 +150,57 @@ private:
 
 struct wd_time_parser : public wd_datavalue_type_parser<wd_time_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "time";
+  static constexpr std::string_view kTypeIdentifier = "time";
+  using value_type = wd_time_t;
   template <typename result_handler, typename columns_type>
-  static auto parse_row(result_handler *handler, const columns_type &columns) {
+  auto parse_row(result_handler *handler, const columns_type &columns) {
     const std::string &time_str =
         columns.template get_field<kDatavalueString>();
     if (time_str == "novalue") {
       handler->handle(columns, wd_novalue_t<wd_time_t>{});
       return;
     }
-    std::smatch time_match;
-    if (!std::regex_match(time_str, time_match, time_regex)) {
-      std::cerr << "Unexpected time string encountered." << std::endl;
-      std::cerr << "time_str: " << time_str << std::endl;
-      std::exit(-1);
-    }
-    std::string time(time_match[1].str());
-    std::optional<iso_time_t> iso8601 = parse_iso8601(time);
-    if (!iso8601.has_value()) {
+    // NOTE year-precision dates (e.g., +2000-00-00T00:00:00Z) recur millions
+    //      of times, so we avoid re-running the regex and date::parse.
+    const std::optional<wd_time_t> &time = cache_.get_or_insert(
+        time_str, [&]() { return parse_time(time_str, &handler->arena()); });
+    if (!time.has_value()) {
       handler->handle(columns, wd_invalid_t<wd_time_t>{});
       return;
     }
+    handler->handle(columns, *time);
+  }
 
-    std::string calendarmodel(time_match[6].str());
-    std::uint64_t timezone(std::stoull(time_match[2].str())),
-        before(std::stoull(time_match[3].str())),
-        after(std::stoull(time_match[4].str())),
-        precision(std::stoull(time_match[5].str()));
-
-    handler->handle(columns, wd_time_t{.time = time,
-                                       .iso8601 = *iso8601,
-                                       .calendermodel = calendarmodel,
-                                       .timezone = timezone,
-                                       .before = before,
-                                       .after = after,
-                                       .precision = precision});
+  auto summary() -> void { cache_.summary("time"); }
+  auto merge_stats(const wd_time_parser &other) -> void {
+    cache_.merge_stats(other.cache_);
   }
 
 private:
-  static auto parse_iso8601(std::string &time) -> std::optional<iso_time_t> {
+  static auto parse_time(const std::string &time_str,
+                         std::pmr::memory_resource *scratch)
+      -> std::optional<wd_time_t> {
+    wd_match time_match(scratch);
+    if (!std::regex_match(time_str, time_match, time_regex)) {
+      throw wd_parse_error("unexpected time string");
+    }
+    std::pmr::string time(time_match[1].first, time_match[1].second,
+                          scratch);
+    std::optional<iso_time_t> iso8601 = parse_iso8601(time);
+    if (!iso8601.has_value()) {
+      return std::nullopt;
+    }
+    return wd_time_t{.time = std::string(time),
+                     .iso8601 = *iso8601,
+                     .calendermodel = time_match[6].str(),
+                     .timezone = parse_match_uint(time_match[2]),
+                     .before = parse_match_uint(time_match[3]),
+                     .after = parse_match_uint(time_match[4]),
+                     .precision = parse_match_uint(time_match[5])};
+  }
+
+  static auto parse_iso8601(std::pmr::string &time)
+      -> std::optional<iso_time_t> {
     // NOTE we convert +YYYY-00-00 to YYYY-01-01 to obtain a valid timestamp
     if (time[6] == '0' && time[7] == '0') {
       time[7] = '1';
@@ -154,7 +208,7 @@ private:
     if (time[9] == '0' && time[10] == '0') {
       time[10] = '1';
     }
-    std::istringstream in{time};
+    wd_istringstream in{std::pmr::string(time, time.get_allocator())};
     date::sys_time<std::chrono::milliseconds> tp;
     in >> date::parse("%FT%TZ", tp);
     if (in.fail()) {
@@ -167,66 +221,85 @@ private:
       "^\\{\"time\"=>\"([^\"]*?)\", \"timezone\"=>(\\d+), \"before\"=>(\\d+), "
       "\"after\"=>(\\d+), \"precision\"=>(\\d+).*, "
       "\"calendarmodel\"=>\"http://www.wikidata.org/entity/([^\"]*?)\"\\}$");
+
+  utils::bounded_cache<std::optional<wd_time_t>> cache_;
 };
 
 struct wd_quantity_parser
     : public wd_datavalue_type_parser<wd_quantity_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "quantity";
+  static constexpr std::string_view kTypeIdentifier = "quantity";
+  using value_type = wd_quantity_t;
   template <typename result_handler, typename columns_type>
-  static auto parse_row(result_handler *handler, const columns_type &columns)
+  auto parse_row(result_handler *handler, const columns_type &columns)
       -> void {
     const std::string &quantity_str =
         columns.template get_field<kDatavalueString>();
-    std::smatch quantity_match;
     if (quantity_str == "novalue") {
       handler->handle(columns, wd_novalue_t<wd_quantity_t>{});
       return;
     }
+    const std::optional<wd_quantity_t> &quantity = cache_.get_or_insert(
+        quantity_str,
+        [&]() { return parse_quantity(quantity_str, &handler->arena()); });
+    if (!quantity.has_value()) {
+      handler->handle(columns, wd_invalid_t<wd_quantity_t>{});
+      return;
+    }
+    handler->handle(columns, *quantity);
+  }
+
+  auto summary() -> void { cache_.summary("quantity"); }
+  auto merge_stats(const wd_quantity_parser &other) -> void {
+    cache_.merge_stats(other.cache_);
+  }
+
+private:
+  static auto parse_quantity(const std::string &quantity_str,
+                             std::pmr::memory_resource *scratch)
+      -> std::optional<wd_quantity_t> {
+    wd_match quantity_match(scratch);
     if (!std::regex_match(quantity_str, quantity_match, quantity_regex)) {
-      std::cerr << "Unexpected quantity string encountered." << std::endl;
-      std::cerr << "quantity_str: " << quantity_str << std::endl;
-      std::exit(-1);
+      throw wd_parse_error("unexpected quantity string");
     }
-    std::string quantity(quantity_match[1].str()),
-        unit_str(quantity_match[2].str()), upper_bound(quantity_match[4].str()),
-        lower_bound(quantity_match[6].str());
+    const std::ssub_match &quantity = quantity_match[1],
+                          &unit_str = quantity_match[2];
 
-    if (quantity.size() == 0 || (quantity[0] != '+' && quantity[0] != '-')) {
-      handler->handle(columns, wd_invalid_t<wd_quantity_t>{});
-      return;
+    if (quantity.length() == 0 ||
+        (*quantity.first != '+' && *quantity.first != '-')) {
+      return std::nullopt;
     }
 
     std::optional<std::string> unit = std::nullopt;
-    if (unit_str != "1") {
-      std::smatch quantity_unit_match;
-      if (!std::regex_match(unit_str, quantity_unit_match,
-                            quantity_unit_regex)) {
-        std::cerr << "Unexpected quantity string encountered." << std::endl;
-        std::cerr << "quantity_str: " << quantity_str << std::endl;
-        std::exit(-1);
+    if (unit_str.compare("1") != 0) {
+      wd_match quantity_unit_match(scratch);
+      if (!std::regex_match(unit_str.first, unit_str.second,
+                            quantity_unit_match, quantity_unit_regex)) {
+        throw wd_parse_error("unexpected quantity unit");
       }
-      unit = quantity_unit_match[1];
+      unit = quantity_unit_match[1].str();
     }
-    handler->handle(columns, wd_quantity_t{.quantity = quantity,
-                                           .unit = unit,
-                                           .lower_bound = lower_bound,
-                                           .upper_bound = upper_bound});
+    return wd_quantity_t{.quantity = quantity.str(),
+                         .unit = unit,
+                         .lower_bound = quantity_match[6].str(),
+                         .upper_bound = quantity_match[4].str()};
   }
 
-private:
   static const inline std::regex quantity_regex = std::regex(
       "\\{\"amount\"=>\"([^\"]*?)\", \"unit\"=>\"([^\"]*?)\"(, "
       "\"upperBound\"=>\"([^\"]*?)\")?(, \"lowerBound\"=>\"([^\"]*?)\")?\\}");
 
   static const inline std::regex quantity_unit_regex =
       std::regex("^http://www.wikidata.org/entity/(.*)$");
+
+  utils::bounded_cache<std::optional<wd_quantity_t>> cache_;
 };
 
 struct wd_coordinate_parser
     : public wd_datavalue_type_parser<wd_coordinate_parser> {
 public:
-  static const inline std::string kTypeIdentifier = "globecoordinate";
+  static constexpr std::string_view kTypeIdentifier = "globecoordinate";
+  using value_type = wd_coordinate_t;
   template <typename result_handler, typename columns_type>
   static auto parse_row(result_handler *handler, const columns_type &columns)
       -> void {
@@ -236,21 +309,16 @@ public:
       handler->handle(columns, wd_novalue_t<wd_coordinate_t>{});
       return;
     }
-    std::smatch coordinate_match;
+    wd_match coordinate_match(&handler->arena());
     if (!std::regex_match(coordinate_str, coordinate_match, coordinate_regex)) {
-      std::cerr << "Unexpected coordinate string encountered." << std::endl;
-      std::cerr << "coordinate_str: " << coordinate_str << std::endl;
-      std::exit(-1);
+      throw wd_parse_error("unexpected coordinate string");
     }
-    std::string latitude(coordinate_match[1].str()),
-        longitude(coordinate_match[2].str()),
-        altitude(coordinate_match[3].str()),
-        precision(coordinate_match[4].str()), globe(coordinate_match[5].str());
-    handler->handle(columns, wd_coordinate_t{.latitude = latitude,
-                                             .longitude = longitude,
-                                             .altitude = altitude,
-                                             .precision = precision,
-                                             .globe = globe});
+    handler->handle(columns,
+                    wd_coordinate_t{.latitude = coordinate_match[1].str(),
+                                    .longitude = coordinate_match[2].str(),
+                                    .altitude = coordinate_match[3].str(),
+                                    .precision = coordinate_match[4].str(),
+                                    .globe = coordinate_match[5].str()});
   }
 
 private:
@@ -266,22 +334,55 @@ template <typename... parsers> struct wd_combined_parser;
 
 template <> struct wd_combined_parser<> {
   template <typename result_handler, typename columns_type>
-  static auto parse_row(result_handler *handler, const columns_type &columns) {
+  auto parse_row(result_handler *handler, const columns_type &columns) {
+    detail::wd_fallback_parser::parse(handler, columns);
+  }
+  template <typename result_handler, typename columns_type>
+  auto parse_novalue_row(result_handler *handler,
+                         const columns_type &columns) {
     detail::wd_fallback_parser::parse(handler, columns);
   }
+  auto summary() -> void {}
+  auto merge_stats(const wd_combined_parser &other) -> void {}
 };
 
 template <typename head, typename... tail>
 struct wd_combined_parser<head, tail...> {
 public:
   template <typename result_handler, typename columns_type>
-  static auto parse_row(result_handler *handler, const columns_type &columns) {
+  auto parse_row(result_handler *handler, const columns_type &columns) {
     if (head::can_parse(columns)) {
-      head::parse_row(handler, columns);
+      head_.parse_row(handler, columns);
     } else {
-      wd_combined_parser<tail...>::parse_row(handler, columns);
+      tail_.parse_row(handler, columns);
     }
   }
+
+  // NOTE "somevalue" and "novalue" snaks carry no datavalue to parse.
+  template <typename result_handler, typename columns_type>
+  auto parse_novalue_row(result_handler *handler,
+                         const columns_type &columns) {
+    if (head::can_parse(columns)) {
+      handler->handle(columns, wd_novalue_t<typename head::value_type>{});
+    } else {
+      tail_.parse_novalue_row(handler, columns);
+    }
+  }
+
+  auto summary() -> void {
+    head_.summary();
+    tail_.summary();
+  }
+
+  // NOTE adds the statistics of other (e.g., of another parser thread).
+  auto merge_stats(const wd_combined_parser &other) -> void {
+    head_.merge_stats(other.head_);
+    tail_.merge_stats(other.tail_);
+  }
+
+private:
+  head head_;
+  wd_combined_parser<tail...> tail_;
 };
 
 using wd_primitives_parser =
@@ -292,24 +393,136 @@ using wd_primitives_parser =
 template <typename tag, typename result_handler,
           typename parser = wd_primitives_parser>
 class wikidata_parser_impl {
-  using columns_type = columns_info_t<tag>;
+  // NOTE columns inspected by the datavalue parsers themselves.
+  using parser_columns =
+      wd_column_set<kEntityId, kSnaktype, kDatavalueType, kDatavalueString,
+                    kDatavalueEntity>;
 
 public:
-  auto parse(const std::string &filename, result_handler *handler) -> void {
-    io::CSVReader<columns_type::size(), io::trim_chars<' '>,
-                  io::no_quote_escape<'\t'>>
-        reader(filename);
+  using columns_type = columns_info_t<
+      tag, wd_column_set_union_t<parser_columns,
+                                 typename result_handler::used_columns>>;
+  using csv_reader = io::CSVReader<columns_type::size(), io::trim_chars<' '>,
+                                   io::no_quote_escape<'\t'>>;
+
+  // NOTE malformed rows are skipped and written to the quarantine (if set).
+  auto parse(const std::string &filename, result_handler *handler,
+             const utils::checkpoint_options &checkpoint = {},
+             const utils::quarantine_options &quarantine = {}) -> void {
+    csv_reader reader(filename);
+    quarantine_.open(quarantine, checkpoint.resume);
+    utils::input_checkpointer checkpointer(checkpoint, filename);
+    // NOTE the position of a checkpoint is the number of lines handled, the
+    //      lines before it are skipped without being tokenized.
+    std::uint64_t line = checkpointer.resume(*handler, quarantine_);
+    for (std::uint64_t skipped = 0; skipped < line; ++skipped) {
+      if (reader.next_line() == nullptr) {
+        std::cerr << "Input ended before the checkpoint: " << filename
+                  << std::endl;
+        std::exit(-1);
+      }
+    }
     utils::progress_indicator progress("parsing " + filename);
     progress.start();
-    while (columns_.read_row(reader)) {
-      parser::parse_row(handler, columns_);
+    // NOTE rows are read into the next slot of block_, so that handling them
+    //      does not copy the columns (see row_block::next_columns).
+    for (columns_type *columns = &block_.next_columns();
+         read_next_row(reader, *columns, line);
+         columns = &block_.next_columns()) {
+      update_entity(handler, checkpointer, *columns, line++);
+      try {
+        if (has_value_snak(*columns)) {
+          parser_.parse_row(&block_, *columns);
+        } else {
+          parser_.parse_novalue_row(&block_, *columns);
+        }
+      } catch (const wd_parse_error &error) {
+        quarantine_.add(line, reader.get_file_line(), error.what(),
+                        columns->template get_field<kDatavalueType>(),
+                        columns->template get_field<kDatavalueString>());
+      }
+      if (block_.full()) {
+        flush_block(handler);
+      }
       progress.update();
     }
+    if (!entity_id_.empty()) {
+      block_.end_entity();
+    }
+    flush_block(handler);
     progress.done();
   }
 
+  auto summary() -> void {
+    parser_.summary();
+    quarantine_.summary();
+  }
+
+  // NOTE snaktype is one of "value", "somevalue" or "novalue".
+  static auto has_value_snak(const columns_type &columns) -> bool {
+    const std::uint8_t snaktype =
+        columns.template get_field<kSnaktype>().code();
+    return snaktype != wd_snaktype_column::code_of("somevalue") &&
+           snaktype != wd_snaktype_column::code_of("novalue");
+  }
+
 protected:
-  columns_type columns_;
+  // NOTE lines that cannot be tokenized (e.g., with too few or too many
+  //      columns) are quarantined like malformed datavalues. The reader has
+  //      already consumed such a line, i.e., reading resumes with the next.
+  auto read_next_row(csv_reader &reader, columns_type &columns,
+                     std::uint64_t &line) -> bool {
+    for (;;) {
+      try {
+        return columns.read_row(reader);
+      } catch (const io::error::base &error) {
+        ++line;
+        quarantine_.add(line, reader.get_file_line(), error.what(), "", "");
+      }
+    }
+  }
+
+  // NOTE the claims are grouped by entity_id, so handlers are notified once
+  //      all rows of an entity have been handled. Checkpoints are only taken
+  //      at these boundaries, position is the number of rows handled before
+  //      the current one.
+  auto update_entity(result_handler *handler,
+                     utils::input_checkpointer &checkpointer,
+                     const columns_type &columns, std::uint64_t position)
+      -> void {
+    if constexpr (columns_type::template has_field<kEntityId>()) {
+      const wd_id_column &entity_id = columns.template get_field<kEntityId>();
+      if (entity_id != entity_id_) {
+        if (!entity_id_.empty()) {
+          block_.end_entity();
+          if (checkpointer.due()) {
+            flush_block(handler);
+            checkpointer.save(position, *handler, quarantine_);
+          }
+        }
+        entity_id_ = entity_id;
+      }
+    } else if (checkpointer.due()) {
+      // NOTE without entities (i.e., for qualifiers) every row is a boundary.
+      flush_block(handler);
+      checkpointer.save(position, *handler, quarantine_);
+    }
+  }
+
+  // NOTE parsed rows are collected in block_ and handed to the handler in
+  //      blocks (see handle_block).
+  auto flush_block(result_handler *handler) -> void {
+    if (!block_.empty()) {
+      handle_block(*handler, block_);
+      block_.clear();
+    }
+  }
+
+  row_block<columns_type> block_;
+  parser parser_;
+  utils::quarantine quarantine_;
+
+  wd_id_column entity_id_;
 };
 } // namespace detail
 
@@ -0,0 +1,327 @@
+#ifndef PARSER_WIKIDATA_SNAPSHOT_H
+#define PARSER_WIKIDATA_SNAPSHOT_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "../utils/snapshot_file.h"
+#include "wikidata_columns.h"
+
+namespace wd_migrate::detail {
+// Columns of a row that are stored in a snapshot.
+// NOTE the raw datavalue columns are not stored, as they are replaced by the
+//      parsed value of the row.
+template <typename tag> struct snapshot_columns;
+template <> struct snapshot_columns<claims_tag_t> {
+  using type = wd_column_set<kEntityId, kClaimId, kClaimsType, kClaimsRank,
+                             kSnaktype, kPropety, kDatavalueType, kDatatype>;
+};
+template <> struct snapshot_columns<qualifiers_tag_t> {
+  using type = wd_column_set<kClaimId, kPropety, kHash, kSnaktype,
+                             kQualifierProperty, kDatavalueType, kDatatype,
+                             kCounter, kOrderHash>;
+};
+template <typename tag>
+using snapshot_columns_t = typename snapshot_columns<tag>::type;
+
+template <typename tag>
+static constexpr std::uint64_t kSnapshotTag =
+    std::is_same_v<tag, claims_tag_t> ? 0 : 1;
+
+// NOTE claim_id is not stored as a column of its own, but as its decoded key
+//      (see snapshot_claim_id_columns).
+template <const char *column_name>
+static constexpr bool kSnapshotColumnStored =
+    !wd_column_set<kClaimId>::contains<column_name>();
+
+// NOTE columns with few distinct values are dictionary encoded.
+constexpr auto snapshot_encoding_of(const char *column_name)
+    -> utils::snapshot_encoding {
+  if (column_name == kCounter || column_name == kOrderHash) {
+    return utils::snapshot_encoding::u64;
+  } else if (column_name == kEntityId || column_name == kHash) {
+    return utils::snapshot_encoding::plain;
+  }
+  return utils::snapshot_encoding::dictionary;
+}
+
+// Columns of the claim_ids, which are stored as their decoded key (see
+// decode_claim_id), i.e., 24 bytes per row instead of the ~50 byte string.
+// NOTE claim_ids that are not of the canonical form are kept in the text
+//      column (which is null for all other rows), their key is 0.
+template <typename column_type> struct snapshot_claim_id_columns {
+  template <typename file_type>
+  snapshot_claim_id_columns(file_type &file)
+      : entity(file, "claim_id.entity", utils::snapshot_encoding::u64),
+        uuid_hi(file, "claim_id.uuid_hi", utils::snapshot_encoding::u64),
+        uuid_lo(file, "claim_id.uuid_lo", utils::snapshot_encoding::u64),
+        text(file, "claim_id.text", utils::snapshot_encoding::dictionary) {}
+
+  column_type entity, uuid_hi, uuid_lo;
+  column_type text;
+};
+
+class snapshot_claim_id_writer {
+public:
+  snapshot_claim_id_writer(utils::snapshot_writer &file) : columns_(file) {}
+
+  auto push(const wd_claim_id_t &claim_id) -> void {
+    const wd_claim_key_t key = claim_id.key.value_or(wd_claim_key_t{});
+    columns_.entity.push(key.entity);
+    columns_.uuid_hi.push(key.uuid_hi);
+    columns_.uuid_lo.push(key.uuid_lo);
+    if (claim_id.key.has_value()) {
+      columns_.text.push_null();
+    } else {
+      columns_.text.push(std::string_view(claim_id.value));
+    }
+  }
+
+private:
+  snapshot_claim_id_columns<utils::snapshot_column_writer> columns_;
+};
+
+class snapshot_claim_id_reader {
+public:
+  snapshot_claim_id_reader(const utils::snapshot_file &file)
+      : columns_(file) {}
+
+  // NOTE appends the original claim_id of row to out.
+  auto append(std::uint64_t row, std::string &out) const -> void {
+    const char *text = columns_.text.c_str(row);
+    if (text != nullptr) {
+      out.append(text);
+      return;
+    }
+    append_claim_id(out, wd_claim_key_t{
+                             .entity = columns_.entity.scalar(row),
+                             .uuid_hi = columns_.uuid_hi.scalar(row),
+                             .uuid_lo = columns_.uuid_lo.scalar(row)});
+  }
+
+private:
+  snapshot_claim_id_columns<utils::snapshot_column_reader> columns_;
+};
+
+// Columns of the parsed values. Every value type has its own columns, which
+// only hold the rows of that type (in row order).
+// NOTE the layout is shared by the snapshot_value_writer/reader.
+// NOTE value.kind and value.key hold one entry per row, where the key is the
+//      tagged entity id of entity values, the iso8601 timestamp (ms since the
+//      epoch) of time values and 0 otherwise, so values can be scanned as
+//      integers.
+template <typename column_type> struct snapshot_value_columns {
+  template <typename file_type>
+  snapshot_value_columns(file_type &file)
+      : kind(file, "value.kind", utils::snapshot_encoding::u8),
+        key(file, "value.key", utils::snapshot_encoding::u64),
+        string(file, "string.value", utils::snapshot_encoding::plain),
+        entity(file, "entity.value", utils::snapshot_encoding::plain),
+        text(file, "text.text", utils::snapshot_encoding::plain),
+        language(file, "text.language", utils::snapshot_encoding::dictionary),
+        time(file, "time.time", utils::snapshot_encoding::plain),
+        iso8601(file, "time.iso8601", utils::snapshot_encoding::u64),
+        calendermodel(file, "time.calendermodel",
+                      utils::snapshot_encoding::dictionary),
+        timezone(file, "time.timezone", utils::snapshot_encoding::u64),
+        before(file, "time.before", utils::snapshot_encoding::u64),
+        after(file, "time.after", utils::snapshot_encoding::u64),
+        precision(file, "time.precision", utils::snapshot_encoding::u8),
+        quantity(file, "quantity.quantity", utils::snapshot_encoding::plain),
+        unit(file, "quantity.unit", utils::snapshot_encoding::dictionary),
+        lower_bound(file, "quantity.lower_bound",
+                    utils::snapshot_encoding::plain),
+        upper_bound(file, "quantity.upper_bound",
+                    utils::snapshot_encoding::plain),
+        latitude(file, "coordinate.latitude", utils::snapshot_encoding::plain),
+        longitude(file, "coordinate.longitude",
+                  utils::snapshot_encoding::plain),
+        altitude(file, "coordinate.altitude",
+                 utils::snapshot_encoding::dictionary),
+        coordinate_precision(file, "coordinate.precision",
+                             utils::snapshot_encoding::dictionary),
+        globe(file, "coordinate.globe", utils::snapshot_encoding::dictionary) {
+  }
+
+  column_type kind, key;
+  column_type string, entity;
+  column_type text, language;
+  column_type time, iso8601, calendermodel, timezone, before, after, precision;
+  column_type quantity, unit, lower_bound, upper_bound;
+  column_type latitude, longitude, altitude, coordinate_precision, globe;
+};
+
+class snapshot_value_writer {
+public:
+  snapshot_value_writer(utils::snapshot_writer &file) : columns_(file) {}
+
+  template <typename value_type> auto push(const value_type &value) -> void {
+    columns_.kind.push(kValueKind<value_type>);
+    columns_.key.push(key(value));
+    write(value);
+  }
+
+private:
+  template <typename value_type>
+  static auto key(const value_type &value) -> std::uint64_t {
+    if constexpr (std::is_same_v<value_type, wd_entity_id_t>) {
+      return value.id;
+    } else if constexpr (std::is_same_v<value_type, wd_time_t>) {
+      return static_cast<std::uint64_t>(
+          value.iso8601.time_since_epoch().count());
+    } else {
+      return 0;
+    }
+  }
+
+  auto write(const wd_string_t &value) -> void {
+    columns_.string.push(value.value);
+  }
+
+  auto write(const wd_entity_id_t &value) -> void {
+    columns_.entity.push(value.value);
+  }
+
+  auto write(const wd_text_t &value) -> void {
+    columns_.text.push(value.text);
+    columns_.language.push(value.language);
+  }
+
+  auto write(const wd_time_t &value) -> void {
+    columns_.time.push(value.time);
+    columns_.iso8601.push(
+        static_cast<std::uint64_t>(value.iso8601.time_since_epoch().count()));
+    columns_.calendermodel.push(value.calendermodel);
+    columns_.timezone.push(value.timezone);
+    columns_.before.push(value.before);
+    columns_.after.push(value.after);
+    columns_.precision.push(value.precision);
+  }
+
+  auto write(const wd_quantity_t &value) -> void {
+    columns_.quantity.push(value.quantity);
+    if (value.unit.has_value()) {
+      columns_.unit.push(*value.unit);
+    } else {
+      columns_.unit.push_null();
+    }
+    columns_.lower_bound.push(value.lower_bound);
+    columns_.upper_bound.push(value.upper_bound);
+  }
+
+  auto write(const wd_coordinate_t &value) -> void {
+    columns_.latitude.push(value.latitude);
+    columns_.longitude.push(value.longitude);
+    columns_.altitude.push(value.altitude);
+    columns_.coordinate_precision.push(value.precision);
+    columns_.globe.push(value.globe);
+  }
+
+  // NOTE novalue and invalid values only store their kind.
+  template <typename type> auto write(const wd_novalue_t<type> &) -> void {}
+
+  snapshot_value_columns<utils::snapshot_column_writer> columns_;
+};
+
+// NOTE read(row) requires rows to be read in order, read_at(kind, index)
+//      accesses the index-th value of the given kind.
+class snapshot_value_reader {
+public:
+  snapshot_value_reader(const utils::snapshot_file &file) : columns_(file) {}
+
+  auto read(std::uint64_t row) -> wd_value_t {
+    const std::uint64_t kind = this->kind(row);
+    return read_at(kind, cursors_[kind]++);
+  }
+
+  // NOTE continues reading at row, counts the values of each kind before it.
+  auto seek(std::uint64_t row) -> void {
+    cursors_.fill(0);
+    for (std::uint64_t index = 0; index < row; ++index) {
+      ++cursors_[kind(index)];
+    }
+  }
+
+  auto kind(std::uint64_t row) const -> std::uint64_t {
+    return columns_.kind.scalar(row);
+  }
+
+  auto read_at(std::uint64_t kind, std::uint64_t index) const -> wd_value_t {
+    static const auto kReaders = make_readers(
+        std::make_index_sequence<std::variant_size_v<wd_value_t>>());
+    return kReaders[kind](*this, index);
+  }
+
+private:
+  using reader_fn = wd_value_t (*)(const snapshot_value_reader &,
+                                   std::uint64_t);
+
+  template <std::size_t... kinds>
+  static auto make_readers(std::index_sequence<kinds...>)
+      -> std::array<reader_fn, sizeof...(kinds)> {
+    return {[](const snapshot_value_reader &reader,
+               std::uint64_t index) -> wd_value_t {
+      return wd_value_t(
+          std::in_place_index<kinds>,
+          reader.read_value<std::variant_alternative_t<kinds, wd_value_t>>(
+              index));
+    }...};
+  }
+
+  template <typename value_type>
+  auto read_value(std::uint64_t index) const -> value_type {
+    if constexpr (std::is_same_v<value_type, wd_string_t>) {
+      return wd_string_t{.value = std::string(columns_.string.view(index))};
+    } else if constexpr (std::is_same_v<value_type, wd_entity_id_t>) {
+      const std::string_view entity = columns_.entity.view(index);
+      return wd_entity_id_t{
+          .value = std::string(entity),
+          .id = encode_entity_id(entity).value_or(kNoEntityId)};
+    } else if constexpr (std::is_same_v<value_type, wd_text_t>) {
+      return wd_text_t{
+          .text = std::string(columns_.text.view(index)),
+          .language = std::string(columns_.language.view(index))};
+    } else if constexpr (std::is_same_v<value_type, wd_time_t>) {
+      return wd_time_t{
+          .time = std::string(columns_.time.view(index)),
+          .iso8601 = iso_time_t(std::chrono::milliseconds(
+              static_cast<std::int64_t>(columns_.iso8601.scalar(index)))),
+          .calendermodel = std::string(columns_.calendermodel.view(index)),
+          .timezone = columns_.timezone.scalar(index),
+          .before = columns_.before.scalar(index),
+          .after = columns_.after.scalar(index),
+          .precision = columns_.precision.scalar(index)};
+    } else if constexpr (std::is_same_v<value_type, wd_quantity_t>) {
+      const char *unit = columns_.unit.c_str(index);
+      return wd_quantity_t{
+          .quantity = std::string(columns_.quantity.view(index)),
+          .unit = (unit != nullptr ? std::optional<std::string>(unit)
+                                   : std::nullopt),
+          .lower_bound = std::string(columns_.lower_bound.view(index)),
+          .upper_bound = std::string(columns_.upper_bound.view(index))};
+    } else if constexpr (std::is_same_v<value_type, wd_coordinate_t>) {
+      return wd_coordinate_t{
+          .latitude = std::string(columns_.latitude.view(index)),
+          .longitude = std::string(columns_.longitude.view(index)),
+          .altitude = std::string(columns_.altitude.view(index)),
+          .precision =
+              std::string(columns_.coordinate_precision.view(index)),
+          .globe = std::string(columns_.globe.view(index))};
+    } else {
+      return value_type{};
+    }
+  }
+
+  snapshot_value_columns<utils::snapshot_column_reader> columns_;
+  // NOTE the number of values read so far, per kind.
+  std::array<std::uint64_t, std::variant_size_v<wd_value_t>> cursors_{};
+};
+} // namespace wd_migrate::detail
+
+#endif // !PARSER_WIKIDATA_SNAPSHOT_H
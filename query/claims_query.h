@@ -0,0 +1,271 @@
+#ifndef QUERY_CLAIMS_QUERY_H
+#define QUERY_CLAIMS_QUERY_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "../parser/wikidata_snapshot.h"
+#include "../utils/date.h"
+#include "../utils/parallel.h"
+#include "../utils/simd_scan.h"
+#include "../utils/snapshot_file.h"
+
+namespace wd_migrate::query {
+// Conjunction of (optional) predicates on the claims of a snapshot.
+struct claims_predicate {
+  std::optional<std::string> property;
+  std::optional<std::string> rank;
+  // NOTE an entity id, e.g., Q5.
+  std::optional<std::string> value;
+  // NOTE inclusive bounds on time values (ms since the epoch).
+  std::optional<std::int64_t> from, to;
+};
+
+// NOTE parses YYYY-MM-DD into ms since the epoch.
+inline auto parse_date(const std::string_view text)
+    -> std::optional<std::int64_t> {
+  std::istringstream in{std::string(text)};
+  date::sys_time<std::chrono::milliseconds> tp;
+  in >> date::parse("%F", tp);
+  if (in.fail()) {
+    return std::nullopt;
+  }
+  return tp.time_since_epoch().count();
+}
+
+// Full scans over the integer-encoded columns of a claims snapshot (see the
+// snapshot subcommand), i.e., the dictionary codes of property and rank and
+// the row-aligned value.kind/value.key columns.
+// NOTE rows are evaluated in blocks of utils::kScanBlockSize, where every
+//      predicate yields a bitmask of the matching rows, and the blocks are
+//      split across threads.
+class claims_query {
+public:
+  claims_query(const std::string &filename)
+      : file_(open_claims(filename)), entity_id_(column(detail::kEntityId)),
+        claim_id_(file_),
+        rank_(column(detail::kClaimsRank)),
+        property_(column(detail::kPropety)),
+        datavalue_type_(column(detail::kDatavalueType)),
+        kind_(file_, "value.kind", utils::snapshot_encoding::u8),
+        key_(file_, "value.key", utils::snapshot_encoding::u64),
+        values_(file_) {}
+
+  auto count(const claims_predicate &predicate, unsigned thread_count) const
+      -> std::uint64_t {
+    const compiled_predicate compiled = compile(predicate);
+    if (compiled.empty) {
+      return 0;
+    }
+    std::vector<std::uint64_t> counts(thread_count);
+    utils::parallel_for(
+        block_count(), thread_count,
+        [&](unsigned thread, std::uint64_t begin, std::uint64_t end) {
+          std::uint64_t count = 0;
+          for (std::uint64_t block = begin; block < end; ++block) {
+            count += std::popcount(match(compiled, block));
+          }
+          counts[thread] = count;
+        });
+    std::uint64_t total = 0;
+    for (const std::uint64_t count : counts) {
+      total += count;
+    }
+    return total;
+  }
+
+  // NOTE writes the matching rows as TSV (entity_id, claim_id, rank,
+  //      property, datavalue_type, value) in row order, returns their number.
+  auto print(const claims_predicate &predicate, unsigned thread_count,
+             std::ostream &output) const -> std::uint64_t {
+    const compiled_predicate compiled = compile(predicate);
+    if (compiled.empty) {
+      return 0;
+    }
+    // NOTE values are stored per kind, so every thread needs the number of
+    //      values of each kind preceding its range.
+    using kind_counts = std::array<std::uint64_t, kKindCount>;
+    std::vector<kind_counts> cursors(thread_count + 1);
+    utils::parallel_for(
+        block_count(), thread_count,
+        [&](unsigned thread, std::uint64_t begin, std::uint64_t end) {
+          count_kinds(
+              begin * utils::kScanBlockSize,
+              std::min(file_.row_count(), end * utils::kScanBlockSize),
+              cursors[thread + 1]);
+        });
+    for (unsigned thread = 1; thread <= thread_count; ++thread) {
+      for (std::uint64_t kind = 0; kind < kKindCount; ++kind) {
+        cursors[thread][kind] += cursors[thread - 1][kind];
+      }
+    }
+
+    std::vector<std::string> outputs(thread_count);
+    std::vector<std::uint64_t> counts(thread_count);
+    utils::parallel_for(
+        block_count(), thread_count,
+        [&](unsigned thread, std::uint64_t begin, std::uint64_t end) {
+          kind_counts &cursor = cursors[thread];
+          std::uint64_t position = begin * utils::kScanBlockSize;
+          for (std::uint64_t block = begin; block < end; ++block) {
+            for (std::uint64_t mask = match(compiled, block); mask != 0;
+                 mask &= mask - 1) {
+              const std::uint64_t row = block * utils::kScanBlockSize +
+                                        std::countr_zero(mask);
+              count_kinds(position, row, cursor);
+              position = row + 1;
+              const std::uint64_t kind = kind_.u8()[row];
+              format_row(row, values_.read_at(kind, cursor[kind]++),
+                         outputs[thread]);
+              ++counts[thread];
+            }
+          }
+        });
+    std::uint64_t total = 0;
+    for (unsigned thread = 0; thread < thread_count; ++thread) {
+      output << outputs[thread];
+      total += counts[thread];
+    }
+    return total;
+  }
+
+private:
+  static constexpr std::uint64_t kKindCount = std::variant_size_v<wd_value_t>;
+
+  struct compiled_predicate {
+    // NOTE a predicate that cannot match (e.g., an unknown property).
+    bool empty = false;
+    std::optional<std::uint32_t> property, rank;
+    std::optional<std::uint8_t> kind;
+    std::optional<std::uint64_t> key;
+    std::optional<std::int64_t> from, to;
+  };
+
+  static auto open_claims(const std::string &filename) -> utils::snapshot_file {
+    utils::snapshot_file file(filename);
+    if (file.tag() != detail::kSnapshotTag<claims_tag_t>) {
+      std::cerr << "Expected a claims snapshot: " << filename << std::endl;
+      std::exit(-1);
+    }
+    return file;
+  }
+
+  auto column(const char *column_name) const -> utils::snapshot_column_reader {
+    return utils::snapshot_column_reader(
+        file_, column_name, detail::snapshot_encoding_of(column_name));
+  }
+
+  auto compile(const claims_predicate &predicate) const
+      -> compiled_predicate {
+    compiled_predicate compiled;
+    const auto resolve = [&](const utils::snapshot_column_reader &reader,
+                             const std::optional<std::string> &value,
+                             std::optional<std::uint32_t> &code) {
+      if (value.has_value()) {
+        code = reader.find_code(*value);
+        compiled.empty |= !code.has_value();
+      }
+    };
+    resolve(property_, predicate.property, compiled.property);
+    resolve(rank_, predicate.rank, compiled.rank);
+    if (predicate.value.has_value()) {
+      compiled.key = encode_entity_id(*predicate.value);
+      if (!compiled.key.has_value()) {
+        std::cerr << "Invalid entity id: " << *predicate.value << std::endl;
+        std::exit(-1);
+      }
+      compiled.kind = detail::kValueKind<wd_entity_id_t>;
+    }
+    if (predicate.from.has_value() || predicate.to.has_value()) {
+      if (compiled.kind.has_value()) {
+        std::cerr << "Cannot combine a value with a time range" << std::endl;
+        std::exit(-1);
+      }
+      compiled.kind = detail::kValueKind<wd_time_t>;
+      compiled.from =
+          predicate.from.value_or(std::numeric_limits<std::int64_t>::min());
+      compiled.to =
+          predicate.to.value_or(std::numeric_limits<std::int64_t>::max());
+    }
+    return compiled;
+  }
+
+  auto block_count() const -> std::uint64_t {
+    return (file_.row_count() + utils::kScanBlockSize - 1) /
+           utils::kScanBlockSize;
+  }
+
+  auto block_end(std::uint64_t block) const -> std::uint64_t {
+    return std::min(file_.row_count(), (block + 1) * utils::kScanBlockSize);
+  }
+
+  // NOTE returns the bitmask of the matching rows of the block.
+  auto match(const compiled_predicate &predicate, std::uint64_t block) const
+      -> std::uint64_t {
+    const std::uint64_t begin = block * utils::kScanBlockSize;
+    const std::uint64_t count = block_end(block) - begin;
+    std::uint64_t mask = count == utils::kScanBlockSize
+                             ? ~std::uint64_t(0)
+                             : (std::uint64_t(1) << count) - 1;
+    if (predicate.property.has_value()) {
+      mask &= utils::scan_equal(property_.codes() + begin, count,
+                                *predicate.property);
+    }
+    if (mask != 0 && predicate.rank.has_value()) {
+      mask &=
+          utils::scan_equal(rank_.codes() + begin, count, *predicate.rank);
+    }
+    if (mask != 0 && predicate.kind.has_value()) {
+      mask &= utils::scan_equal(kind_.u8() + begin, count, *predicate.kind);
+    }
+    if (mask != 0 && predicate.key.has_value()) {
+      mask &= utils::scan_equal(key_.u64() + begin, count, *predicate.key);
+    }
+    if (mask != 0 && predicate.from.has_value()) {
+      mask &= utils::scan_range(
+          reinterpret_cast<const std::int64_t *>(key_.u64()) + begin, count,
+          *predicate.from, *predicate.to);
+    }
+    return mask;
+  }
+
+  auto count_kinds(std::uint64_t begin, std::uint64_t end,
+                   std::array<std::uint64_t, kKindCount> &counts) const
+      -> void {
+    for (std::uint64_t row = begin; row < end; ++row) {
+      ++counts[kind_.u8()[row]];
+    }
+  }
+
+  auto format_row(std::uint64_t row, const wd_value_t &value,
+                  std::string &out) const -> void {
+    out.append(entity_id_.view(row)).push_back('\t');
+    claim_id_.append(row, out);
+    out.push_back('\t');
+    out.append(rank_.view(row)).push_back('\t');
+    out.append(property_.view(row)).push_back('\t');
+    out.append(datavalue_type_.view(row)).push_back('\t');
+    out.append(render_value(value).value_or("")).push_back('\n');
+  }
+
+  utils::snapshot_file file_;
+  utils::snapshot_column_reader entity_id_;
+  detail::snapshot_claim_id_reader claim_id_;
+  utils::snapshot_column_reader rank_, property_, datavalue_type_, kind_, key_;
+  detail::snapshot_value_reader values_;
+};
+} // namespace wd_migrate::query
+
+#endif // !QUERY_CLAIMS_QUERY_H
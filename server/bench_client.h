@@ -0,0 +1,106 @@
+#ifndef SERVER_BENCH_CLIENT_H
+#define SERVER_BENCH_CLIENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../utils/unix_socket.h"
+
+namespace wd_migrate::server {
+// Replays lookups (request targets, e.g., /entity/Q42) against a
+// lookup_server and reports the throughput and latency percentiles.
+// NOTE every connection sends its requests sequentially over a single
+//      kept-alive connection, i.e., connections is the concurrency.
+class bench_client {
+public:
+  bench_client(const std::string &socket_path, unsigned connections)
+      : socket_path_(socket_path), connections_(std::max(1u, connections)) {}
+
+  auto run(const std::vector<std::string> &targets) -> void {
+    std::vector<std::vector<std::uint64_t>> latencies(connections_);
+    std::atomic<std::uint64_t> errors = 0;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned connection = 0; connection < connections_; ++connection) {
+      workers.emplace_back([&, connection]() {
+        std::optional<utils::socket_stream> stream =
+            utils::socket_stream::connect(socket_path_);
+        if (!stream.has_value()) {
+          ++errors;
+          return;
+        }
+        for (std::uint64_t index = connection; index < targets.size();
+             index += connections_) {
+          const auto begin = std::chrono::steady_clock::now();
+          if (!request(*stream, targets[index])) {
+            ++errors;
+            return;
+          }
+          latencies[connection].push_back(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - begin)
+                  .count());
+        }
+      });
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    std::vector<std::uint64_t> all;
+    for (const std::vector<std::uint64_t> &partial : latencies) {
+      all.insert(all.end(), partial.begin(), partial.end());
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << "requests: " << all.size() << " (errors: " << errors
+              << "), qps: " << all.size() / seconds << std::endl;
+    if (all.empty()) {
+      return;
+    }
+    const auto percentile = [&](double p) {
+      return all[std::min<std::uint64_t>(all.size() - 1, p * all.size())] /
+             1000.0;
+    };
+    std::cout << "latency (us): p50 " << percentile(0.5) << ", p90 "
+              << percentile(0.9) << ", p99 " << percentile(0.99)
+              << ", p99.9 " << percentile(0.999) << ", max "
+              << all.back() / 1000.0 << std::endl;
+  }
+
+private:
+  // NOTE reads (and discards) the full response body.
+  static auto request(utils::socket_stream &stream, const std::string &target)
+      -> bool {
+    if (!stream.write_all("GET " + target + " HTTP/1.1\r\n\r\n")) {
+      return false;
+    }
+    const std::optional<std::string> head = stream.read_until("\r\n\r\n");
+    if (!head.has_value()) {
+      return false;
+    }
+    static constexpr std::string_view kContentLength = "Content-Length: ";
+    const std::uint64_t position = head->find(kContentLength);
+    if (position == std::string::npos) {
+      return false;
+    }
+    const std::uint64_t size =
+        std::stoull(head->substr(position + kContentLength.size()));
+    return stream.read_exact(size).has_value();
+  }
+
+  std::string socket_path_;
+  unsigned connections_;
+};
+} // namespace wd_migrate::server
+
+#endif // !SERVER_BENCH_CLIENT_H
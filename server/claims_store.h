@@ -0,0 +1,170 @@
+#ifndef SERVER_CLAIMS_STORE_H
+#define SERVER_CLAIMS_STORE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "../parser/wikidata_snapshot.h"
+#include "../utils/hash.h"
+#include "../utils/snapshot_file.h"
+
+namespace wd_migrate::server {
+// Read-only random access to the claims of a snapshot (see the snapshot
+// subcommand), answering
+//   - all claims of an entity, and
+//   - all claims with a given (property, value).
+// NOTE the snapshot is memory-mapped, the indexes are built in memory when
+//      the store is opened (~20 bytes per claim).
+class claims_store {
+public:
+  claims_store(const std::string &filename)
+      : file_(open_claims(filename)), entity_id_(column(detail::kEntityId)),
+        claim_id_(file_),
+        rank_(column(detail::kClaimsRank)),
+        property_(column(detail::kPropety)),
+        datavalue_type_(column(detail::kDatavalueType)), values_(file_) {
+    build_indexes();
+  }
+
+  auto row_count() const -> std::uint64_t { return file_.row_count(); }
+  auto entity_count() const -> std::uint64_t { return entities_.size(); }
+
+  // NOTE the claims are appended to out as TSV rows, returns their number.
+  auto entity_claims(const std::string_view entity_id, std::string &out) const
+      -> std::uint64_t {
+    const std::uint64_t key = utils::hash128(entity_id).hi;
+    auto it = std::lower_bound(
+        entities_.begin(), entities_.end(), key,
+        [](const entity_run &run, std::uint64_t key) { return run.key < key; });
+    for (; it != entities_.end() && it->key == key; ++it) {
+      if (entity_id_.view(it->begin) == entity_id) {
+        for (std::uint64_t row = it->begin; row < it->end; ++row) {
+          format_row(row, out);
+        }
+        return it->end - it->begin;
+      }
+    }
+    return 0;
+  }
+
+  auto property_claims(const std::string_view property,
+                       const std::string_view value, std::string &out) const
+      -> std::uint64_t {
+    const std::uint64_t key = property_value_key(property, value);
+    auto it = std::lower_bound(
+        property_values_.begin(), property_values_.end(), key,
+        [](const property_value &entry, std::uint64_t key) {
+          return entry.key < key;
+        });
+    std::uint64_t count = 0;
+    for (; it != property_values_.end() && it->key == key; ++it) {
+      if (property_.view(it->row) == property &&
+          render_value(read_value(it->row)) == value) {
+        format_row(it->row, out);
+        ++count;
+      }
+    }
+    return count;
+  }
+
+private:
+  struct entity_run {
+    std::uint64_t key;
+    std::uint64_t begin, end;
+  };
+
+  struct property_value {
+    std::uint64_t key;
+    std::uint64_t row;
+
+    auto operator<(const property_value &other) const -> bool {
+      return key < other.key || (key == other.key && row < other.row);
+    }
+  };
+
+  static auto open_claims(const std::string &filename) -> utils::snapshot_file {
+    utils::snapshot_file file(filename);
+    if (file.tag() != detail::kSnapshotTag<claims_tag_t>) {
+      std::cerr << "Expected a claims snapshot: " << filename << std::endl;
+      std::exit(-1);
+    }
+    return file;
+  }
+
+  auto column(const char *column_name) const -> utils::snapshot_column_reader {
+    return utils::snapshot_column_reader(
+        file_, column_name, detail::snapshot_encoding_of(column_name));
+  }
+
+  static auto property_value_key(const std::string_view property,
+                                 const std::string_view value)
+      -> std::uint64_t {
+    std::string key;
+    key.reserve(property.size() + 1 + value.size());
+    key.append(property).push_back('\t');
+    key.append(value);
+    return utils::hash128(key).hi;
+  }
+
+  auto read_value(std::uint64_t row) const -> wd_value_t {
+    return values_.read_at(values_.kind(row), value_index_[row]);
+  }
+
+  auto build_indexes() -> void {
+    value_index_.resize(row_count());
+    std::array<std::uint64_t, std::variant_size_v<wd_value_t>> cursors{};
+    for (std::uint64_t row = 0; row < row_count(); ++row) {
+      value_index_[row] = cursors[values_.kind(row)]++;
+      if (row == 0 || entity_id_.view(row) != entity_id_.view(row - 1)) {
+        entities_.push_back(entity_run{
+            .key = utils::hash128(entity_id_.view(row)).hi,
+            .begin = row,
+            .end = row + 1});
+      }
+      entities_.back().end = row + 1;
+      if (const auto value = render_value(read_value(row));
+          value.has_value()) {
+        property_values_.push_back(property_value{
+            .key = property_value_key(property_.view(row), *value),
+            .row = row});
+      }
+    }
+    std::sort(entities_.begin(), entities_.end(),
+              [](const entity_run &lhs, const entity_run &rhs) {
+                return lhs.key < rhs.key;
+              });
+    std::sort(property_values_.begin(), property_values_.end());
+  }
+
+  auto format_row(std::uint64_t row, std::string &out) const -> void {
+    out.append(entity_id_.view(row)).push_back('\t');
+    claim_id_.append(row, out);
+    out.push_back('\t');
+    out.append(rank_.view(row)).push_back('\t');
+    out.append(property_.view(row)).push_back('\t');
+    out.append(datavalue_type_.view(row)).push_back('\t');
+    out.append(render_value(read_value(row)).value_or("")).push_back('\n');
+  }
+
+  utils::snapshot_file file_;
+  utils::snapshot_column_reader entity_id_;
+  detail::snapshot_claim_id_reader claim_id_;
+  utils::snapshot_column_reader rank_, property_, datavalue_type_;
+  detail::snapshot_value_reader values_;
+
+  // NOTE index of the value of each row within the columns of its kind.
+  std::vector<std::uint32_t> value_index_;
+  std::vector<entity_run> entities_;
+  std::vector<property_value> property_values_;
+};
+} // namespace wd_migrate::server
+
+#endif // !SERVER_CLAIMS_STORE_H
@@ -0,0 +1,114 @@
+#ifndef SERVER_LOOKUP_SERVER_H
+#define SERVER_LOOKUP_SERVER_H
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "../utils/unix_socket.h"
+#include "claims_store.h"
+
+namespace wd_migrate::server {
+namespace detail {
+inline auto url_decode(const std::string_view text) -> std::string {
+  std::string decoded;
+  for (std::uint64_t index = 0; index < text.size(); ++index) {
+    if (text[index] == '%' && index + 2 < text.size()) {
+      const int hi = wd_migrate::detail::hex_digit(text[index + 1]);
+      const int lo = wd_migrate::detail::hex_digit(text[index + 2]);
+      if (hi >= 0 && lo >= 0) {
+        decoded.push_back(static_cast<char>(16 * hi + lo));
+        index += 2;
+        continue;
+      }
+    }
+    decoded.push_back(text[index] == '+' ? ' ' : text[index]);
+  }
+  return decoded;
+}
+} // namespace detail
+
+// Answers lookups over HTTP/1.1 on a Unix domain socket:
+//   GET /entity/<entity_id>            all claims of the entity
+//   GET /property/<property>/<value>   all claims with the property and value
+// Responses are TSV rows (entity_id, claim_id, rank, property,
+// datavalue_type, value), see render_value for the value.
+// NOTE connections are kept alive and served by one thread each.
+class lookup_server {
+public:
+  lookup_server(const claims_store &store) : store_(store) {}
+
+  auto serve(const std::string &socket_path) -> void {
+    utils::unix_listener listener(socket_path);
+    std::cout << "serving " << store_.row_count() << " claims of "
+              << store_.entity_count() << " entities on " << socket_path
+              << std::endl;
+    while (true) {
+      std::optional<utils::socket_stream> connection = listener.accept();
+      if (connection.has_value()) {
+        std::thread([this, stream = std::move(*connection)]() mutable {
+          handle_connection(stream);
+        }).detach();
+      }
+    }
+  }
+
+private:
+  auto handle_connection(utils::socket_stream &stream) -> void {
+    std::string body;
+    while (const auto head = stream.read_until("\r\n\r\n")) {
+      // NOTE the request line is <method> <target> HTTP/1.1.
+      const std::uint64_t target_begin = head->find(' ') + 1;
+      const std::uint64_t target_end = head->find(' ', target_begin);
+      if (target_begin == 0 || target_end == std::string::npos) {
+        return;
+      }
+      body.clear();
+      const bool found = respond(
+          std::string_view(*head).substr(target_begin,
+                                         target_end - target_begin),
+          body);
+      std::string response = found ? "HTTP/1.1 200 OK\r\n"
+                                   : "HTTP/1.1 404 Not Found\r\n";
+      response += "Content-Type: text/tab-separated-values\r\n"
+                  "Content-Length: " +
+                  std::to_string(body.size()) + "\r\n\r\n";
+      response += body;
+      if (!stream.write_all(response) ||
+          head->find("Connection: close") != std::string::npos) {
+        return;
+      }
+    }
+  }
+
+  // NOTE returns false for unknown targets.
+  auto respond(const std::string_view target, std::string &body) const
+      -> bool {
+    static constexpr std::string_view kEntity = "/entity/";
+    static constexpr std::string_view kProperty = "/property/";
+    if (target.starts_with(kEntity)) {
+      store_.entity_claims(detail::url_decode(target.substr(kEntity.size())),
+                           body);
+      return true;
+    } else if (target.starts_with(kProperty)) {
+      const std::string_view query = target.substr(kProperty.size());
+      const std::uint64_t separator = query.find('/');
+      if (separator == std::string_view::npos) {
+        return false;
+      }
+      store_.property_claims(
+          detail::url_decode(query.substr(0, separator)),
+          detail::url_decode(query.substr(separator + 1)), body);
+      return true;
+    }
+    return false;
+  }
+
+  const claims_store &store_;
+};
+} // namespace wd_migrate::server
+
+#endif // !SERVER_LOOKUP_SERVER_H
@@ -0,0 +1,83 @@
+#ifndef UTILS_ARENA_H
+#define UTILS_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Monotonic memory resource for short-lived scratch allocations (e.g., the
+// temporaries of parsing a block of rows). Allocations bump a pointer into
+// the current buffer, deallocations are no-ops and reset() releases all of
+// them at once.
+// NOTE the buffers are kept across resets, i.e., once the arena has grown
+//      to its working set it no longer touches the heap.
+class arena : public std::pmr::memory_resource {
+public:
+  static constexpr std::uint64_t kBufferSize = 64 << 10;
+
+  // NOTE moving the arena keeps its buffers, but invalidates allocators
+  //      pointing to it, i.e., it must only be moved while unused.
+  arena() = default;
+  arena(arena &&) = default;
+  auto operator=(arena &&) -> arena & = default;
+
+  // NOTE O(1), the buffers are reused in order by the next allocations.
+  auto reset() -> void {
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  // NOTE the total size of the buffers, i.e., the peak working set.
+  auto capacity() const -> std::uint64_t {
+    std::uint64_t size = 0;
+    for (const buffer &block : buffers_) {
+      size += block.size;
+    }
+    return size;
+  }
+
+private:
+  struct buffer {
+    std::unique_ptr<std::byte[]> data;
+    std::uint64_t size;
+  };
+
+  auto do_allocate(std::size_t bytes, std::size_t alignment)
+      -> void * override {
+    for (; current_ < buffers_.size(); ++current_, offset_ = 0) {
+      const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(
+          buffers_[current_].data.get() + offset_);
+      const std::uint64_t begin =
+          offset_ + (alignment - address % alignment) % alignment;
+      if (begin + bytes <= buffers_[current_].size) {
+        offset_ = begin + bytes;
+        return buffers_[current_].data.get() + begin;
+      }
+    }
+    // NOTE over-allocates by alignment, so that the allocation fits the new
+    //      buffer regardless of the alignment of its data.
+    const std::uint64_t size = std::max<std::uint64_t>(
+        kBufferSize, bytes + std::max<std::size_t>(alignment, 1));
+    buffers_.push_back(
+        buffer{.data = std::make_unique<std::byte[]>(size), .size = size});
+    offset_ = 0;
+    return do_allocate(bytes, alignment);
+  }
+
+  auto do_deallocate(void *, std::size_t, std::size_t) -> void override {}
+
+  auto do_is_equal(const std::pmr::memory_resource &other) const noexcept
+      -> bool override {
+    return this == &other;
+  }
+
+  std::vector<buffer> buffers_;
+  std::uint64_t current_ = 0, offset_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_ARENA_H
@@ -0,0 +1,165 @@
+#ifndef UTILS_BLOOM_FILTER_H
+#define UTILS_BLOOM_FILTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "hash.h"
+#include "mmap_file.h"
+
+namespace wd_migrate::utils {
+// Split block Bloom filter over 64-bit keys (as used by Parquet), i.e., every
+// key sets one bit in each of the eight 32-bit words of a single 256-bit
+// block, so a probe touches a single cache line.
+// Layout (little-endian):
+//   bloom_filter_header
+//   blocks: block_count x bloom_block
+static constexpr char kBloomFilterMagic[8] = {'W', 'D', 'B', 'L',
+                                              'M', '0', '0', '1'};
+
+// NOTE the header is 32 bytes, so the mapped blocks stay aligned.
+struct bloom_filter_header {
+  char magic[8];
+  std::uint64_t block_count, key_count, bits_per_key;
+};
+
+struct alignas(32) bloom_block {
+  std::uint32_t words[8];
+};
+
+namespace detail {
+inline constexpr std::uint32_t kBloomSalts[8] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+inline auto bloom_mask(std::uint32_t key, std::uint32_t word)
+    -> std::uint32_t {
+  return std::uint32_t(1) << ((key * kBloomSalts[word]) >> 27);
+}
+
+inline auto bloom_block_index(std::uint64_t hash, std::uint64_t block_count)
+    -> std::uint64_t {
+  return ((hash >> 32) * block_count) >> 32;
+}
+
+inline auto bloom_contains(std::span<const bloom_block> blocks,
+                           std::uint64_t key) -> bool {
+  const std::uint64_t hash = fmix64(key);
+  const bloom_block &block = blocks[bloom_block_index(hash, blocks.size())];
+  for (std::uint32_t word = 0; word < 8; ++word) {
+    if ((block.words[word] & bloom_mask(std::uint32_t(hash), word)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace detail
+
+// NOTE the filter is sized once all keys are known, i.e., keys are collected
+//      (and deduplicated) before any bit is set.
+struct bloom_filter_builder {
+public:
+  bloom_filter_builder(std::uint64_t bits_per_key)
+      : bits_per_key_(std::max<std::uint64_t>(bits_per_key, 1)) {}
+
+  auto add(std::uint64_t key) -> void {
+    keys_.push_back(key);
+    if (keys_.size() >= compact_at_) {
+      compact();
+      compact_at_ = std::max(compact_at_, 2 * keys_.size());
+    }
+  }
+
+  auto write(const std::string &filename) -> void {
+    compact();
+    // NOTE block_index requires block_count < 2^32.
+    const std::uint64_t block_count = std::clamp<std::uint64_t>(
+        (keys_.size() * bits_per_key_ + 255) / 256, 1,
+        std::numeric_limits<std::uint32_t>::max());
+    std::vector<bloom_block> blocks(block_count);
+    for (const std::uint64_t key : keys_) {
+      const std::uint64_t hash = detail::fmix64(key);
+      bloom_block &block =
+          blocks[detail::bloom_block_index(hash, block_count)];
+      for (std::uint32_t word = 0; word < 8; ++word) {
+        block.words[word] |= detail::bloom_mask(std::uint32_t(hash), word);
+      }
+    }
+    bloom_filter_header header;
+    std::copy(std::begin(kBloomFilterMagic), std::end(kBloomFilterMagic),
+              header.magic);
+    header.block_count = block_count;
+    header.key_count = keys_.size();
+    header.bits_per_key = bits_per_key_;
+    std::ofstream output(filename, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(blocks.data()),
+                 sizeof(bloom_block) * blocks.size());
+  }
+
+  // NOTE the number of distinct keys added so far.
+  auto size() -> std::uint64_t {
+    compact();
+    return keys_.size();
+  }
+
+  auto save_checkpoint(checkpoint_writer &writer) -> void {
+    compact();
+    writer.write(keys_);
+  }
+
+  auto load_checkpoint(checkpoint_reader &reader) -> void {
+    reader.read(keys_);
+  }
+
+private:
+  auto compact() -> void {
+    std::sort(keys_.begin(), keys_.end());
+    keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+  }
+
+  const std::uint64_t bits_per_key_;
+  std::vector<std::uint64_t> keys_;
+  std::uint64_t compact_at_ = std::uint64_t(1) << 20;
+};
+
+// Probes a memory-mapped filter.
+// NOTE contains() has no false negatives.
+struct bloom_filter_view {
+public:
+  bloom_filter_view(const std::string &filename) : file_(filename) {
+    if (file_.size() < sizeof(bloom_filter_header) ||
+        std::memcmp(file_.data(), kBloomFilterMagic,
+                    sizeof(kBloomFilterMagic)) != 0) {
+      std::cerr << "Invalid filter file: " << filename << std::endl;
+      std::exit(-1);
+    }
+    const bloom_filter_header *header = file_.at<bloom_filter_header>(0);
+    blocks_ = {file_.at<bloom_block>(sizeof(bloom_filter_header)),
+               header->block_count};
+    key_count_ = header->key_count;
+  }
+
+  auto contains(std::uint64_t key) const -> bool {
+    return detail::bloom_contains(blocks_, key);
+  }
+
+  auto key_count() const -> std::uint64_t { return key_count_; }
+
+private:
+  mmap_file file_;
+  std::span<const bloom_block> blocks_;
+  std::uint64_t key_count_;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_BLOOM_FILTER_H
@@ -0,0 +1,70 @@
+#ifndef UTILS_BOUNDED_CACHE_H
+#define UTILS_BOUNDED_CACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Direct-mapped cache keyed on raw input strings. Colliding keys simply
+// overwrite each other's slot, which bounds memory without any eviction
+// bookkeeping on the hot path.
+template <typename value_type, std::uint64_t capacity = (1 << 16)>
+struct bounded_cache {
+  static_assert((capacity & (capacity - 1)) == 0,
+                "bounded_cache capacity must be a power of two.");
+
+public:
+  bounded_cache() : slots_(capacity) {}
+
+  // Returns the cached value for key, computing (and caching) it on a miss.
+  template <typename compute_fn>
+  auto get_or_insert(const std::string &key, compute_fn &&compute)
+      -> const value_type & {
+    const std::uint64_t hash = std::hash<std::string>{}(key);
+    slot &entry = slots_[hash & (capacity - 1)];
+    if (entry.value.has_value() && entry.hash == hash && entry.key == key) {
+      ++hits_;
+      return *entry.value;
+    }
+    ++misses_;
+    entry.hash = hash;
+    entry.key = key;
+    entry.value.reset();
+    entry.value.emplace(compute());
+    return *entry.value;
+  }
+
+  // NOTE only merges the hit statistics, e.g., of per-thread caches.
+  auto merge_stats(const bounded_cache &other) -> void {
+    hits_ += other.hits_;
+    misses_ += other.misses_;
+  }
+
+  auto hits() const -> std::uint64_t { return hits_; }
+  auto misses() const -> std::uint64_t { return misses_; }
+
+  auto summary(const std::string &label) const -> void {
+    const std::uint64_t lookups = hits_ + misses_;
+    std::cout << label << " cache: " << hits_ << "/" << lookups << " hits ("
+              << (lookups == 0 ? 0.0 : 100.0 * hits_ / lookups) << "%)"
+              << std::endl;
+  }
+
+private:
+  struct slot {
+    std::uint64_t hash = 0;
+    std::string key;
+    std::optional<value_type> value;
+  };
+
+  std::vector<slot> slots_;
+  std::uint64_t hits_ = 0, misses_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_BOUNDED_CACHE_H
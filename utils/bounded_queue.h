@@ -0,0 +1,55 @@
+#ifndef UTILS_BOUNDED_QUEUE_H
+#define UTILS_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace wd_migrate::utils {
+// Blocking FIFO between producer and consumer threads. push blocks while the
+// queue holds capacity elements, pop blocks while it is empty.
+// NOTE once close() is called, pop drains the remaining elements and then
+//      returns std::nullopt.
+template <typename value_type> class bounded_queue {
+public:
+  bounded_queue(std::uint64_t capacity) : capacity_(capacity) {}
+
+  auto push(value_type value) -> void {
+    std::unique_lock lock(mutex_);
+    not_full_.wait(lock, [&]() { return values_.size() < capacity_; });
+    values_.push_back(std::move(value));
+    not_empty_.notify_one();
+  }
+
+  auto pop() -> std::optional<value_type> {
+    std::unique_lock lock(mutex_);
+    not_empty_.wait(lock, [&]() { return !values_.empty() || closed_; });
+    if (values_.empty()) {
+      return std::nullopt;
+    }
+    value_type value = std::move(values_.front());
+    values_.pop_front();
+    not_full_.notify_one();
+    return value;
+  }
+
+  auto close() -> void {
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  const std::uint64_t capacity_;
+  std::deque<value_type> values_;
+  bool closed_ = false;
+
+  std::mutex mutex_;
+  std::condition_variable not_empty_, not_full_;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_BOUNDED_QUEUE_H
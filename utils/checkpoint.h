@@ -0,0 +1,206 @@
+#ifndef UTILS_CHECKPOINT_H
+#define UTILS_CHECKPOINT_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Binary file holding the input position and the state of every handler in
+// the stack, so a conversion can resume from it instead of from the start.
+// Layout:
+//   kCheckpointMagic
+//   input size (u64), input position (u64)
+//   handler state, see save_checkpoint/load_checkpoint of the handlers
+static constexpr char kCheckpointMagic[8] = {'W', 'D', 'C', 'K',
+                                             'P', '0', '0', '1'};
+
+struct checkpoint_options {
+  // NOTE checkpoints are disabled if filename is empty.
+  std::string filename;
+  std::chrono::seconds interval{300};
+  bool resume = false;
+};
+
+// NOTE the checkpoint is written to <filename>.tmp and only replaces the
+//      previous one once it is complete (see commit).
+class checkpoint_writer {
+public:
+  checkpoint_writer(const std::string &filename)
+      : filename_(filename), output_(temp_filename(), std::ios::binary) {
+    output_.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+  }
+
+  template <typename type> auto write(const type &value) -> void {
+    static_assert(std::is_trivially_copyable_v<type>);
+    output_.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  auto write(const std::string &value) -> void {
+    write<std::uint64_t>(value.size());
+    output_.write(value.data(), value.size());
+  }
+
+  template <typename type> auto write(const std::vector<type> &values) -> void {
+    static_assert(std::is_trivially_copyable_v<type>);
+    write<std::uint64_t>(values.size());
+    output_.write(reinterpret_cast<const char *>(values.data()),
+                  sizeof(type) * values.size());
+  }
+
+  template <typename key_type, typename type>
+  auto write(const std::unordered_map<key_type, type> &values) -> void {
+    write<std::uint64_t>(values.size());
+    for (const auto &[key, value] : values) {
+      write(key);
+      write(value);
+    }
+  }
+
+  auto commit() -> void {
+    output_.close();
+    if (!output_) {
+      std::cerr << "Failed to write checkpoint: " << filename_ << std::endl;
+      std::exit(-1);
+    }
+    std::filesystem::rename(temp_filename(), filename_);
+  }
+
+private:
+  auto temp_filename() const -> std::string { return filename_ + ".tmp"; }
+
+  std::string filename_;
+  std::ofstream output_;
+};
+
+class checkpoint_reader {
+public:
+  checkpoint_reader(const std::string &filename)
+      : filename_(filename), input_(filename, std::ios::binary) {
+    char magic[sizeof(kCheckpointMagic)];
+    if (!input_.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0) {
+      std::cerr << "Invalid checkpoint file: " << filename << std::endl;
+      std::exit(-1);
+    }
+  }
+
+  template <typename type> auto read(type &value) -> void {
+    static_assert(std::is_trivially_copyable_v<type>);
+    input_.read(reinterpret_cast<char *>(&value), sizeof(value));
+    check();
+  }
+
+  auto read(std::string &value) -> void {
+    value.resize(read_size());
+    input_.read(value.data(), value.size());
+    check();
+  }
+
+  template <typename type> auto read(std::vector<type> &values) -> void {
+    static_assert(std::is_trivially_copyable_v<type>);
+    values.resize(read_size());
+    input_.read(reinterpret_cast<char *>(values.data()),
+                sizeof(type) * values.size());
+    check();
+  }
+
+  template <typename key_type, typename type>
+  auto read(std::unordered_map<key_type, type> &values) -> void {
+    const std::uint64_t size = read_size();
+    values.clear();
+    values.reserve(size);
+    for (std::uint64_t index = 0; index < size; ++index) {
+      key_type key;
+      read(key);
+      read(values[key]);
+    }
+  }
+
+private:
+  auto read_size() -> std::uint64_t {
+    std::uint64_t size;
+    read(size);
+    return size;
+  }
+
+  auto check() -> void {
+    if (!input_) {
+      std::cerr << "Truncated checkpoint file: " << filename_ << std::endl;
+      std::exit(-1);
+    }
+  }
+
+  std::string filename_;
+  std::ifstream input_;
+};
+
+// Takes a checkpoint of the handler stack at most once per interval.
+// NOTE the position is opaque to the checkpoint, e.g., the number of lines
+//      or rows of the input that have been fully handled.
+class input_checkpointer {
+public:
+  input_checkpointer(const checkpoint_options &options,
+                     const std::string &input)
+      : options_(options),
+        input_size_(enabled() ? std::filesystem::file_size(input) : 0),
+        last_(std::chrono::steady_clock::now()) {}
+
+  auto enabled() const -> bool { return !options_.filename.empty(); }
+
+  // NOTE the clock is only read every kCheckInterval calls.
+  auto due() -> bool {
+    return enabled() && ++calls_ % kCheckInterval == 0 &&
+           std::chrono::steady_clock::now() - last_ >= options_.interval;
+  }
+
+  // NOTE states are, e.g., the handler stack, saved in the given order.
+  template <typename... state_types>
+  auto save(std::uint64_t position, state_types &...states) -> void {
+    checkpoint_writer writer(options_.filename);
+    writer.write(input_size_);
+    writer.write(position);
+    (states.save_checkpoint(writer), ...);
+    writer.commit();
+    last_ = std::chrono::steady_clock::now();
+  }
+
+  // NOTE returns the position to continue from (0 unless resuming).
+  template <typename... state_types>
+  auto resume(state_types &...states) -> std::uint64_t {
+    if (!enabled() || !options_.resume) {
+      return 0;
+    }
+    checkpoint_reader reader(options_.filename);
+    std::uint64_t input_size, position;
+    reader.read(input_size);
+    reader.read(position);
+    if (input_size != input_size_) {
+      std::cerr << "Checkpoint does not match the input: "
+                << options_.filename << std::endl;
+      std::exit(-1);
+    }
+    (states.load_checkpoint(reader), ...);
+    std::cout << "resuming at position " << position << std::endl;
+    return position;
+  }
+
+private:
+  static constexpr std::uint64_t kCheckInterval = 1024;
+
+  const checkpoint_options options_;
+  const std::uint64_t input_size_;
+  std::chrono::steady_clock::time_point last_;
+  std::uint64_t calls_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_CHECKPOINT_H
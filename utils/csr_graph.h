@@ -0,0 +1,88 @@
+#ifndef UTILS_CSR_GRAPH_H
+#define UTILS_CSR_GRAPH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+
+#include "mmap_file.h"
+
+namespace wd_migrate::utils {
+// Compressed sparse row file of entity-to-entity edges.
+// Layout (little-endian, 8-byte aligned):
+//   csr_header
+//   nodes:   node_count x u64, tagged entity ids in ascending order. The
+//            index of an entity in this array is its dense node id.
+//   offsets: (node_count + 1) x u64, edges of node i are [offsets[i],
+//            offsets[i + 1]).
+//   edges:   edge_count x csr_edge, sorted by (property, target) per node.
+static constexpr char kCSRMagic[8] = {'W', 'D', 'C', 'S', 'R', '0', '0', '1'};
+
+struct csr_header {
+  char magic[8];
+  std::uint64_t node_count, edge_count;
+  std::uint64_t nodes_offset, offsets_offset, edges_offset;
+};
+
+struct csr_edge {
+  // NOTE the property number, e.g., 31 for P31.
+  std::uint32_t property;
+  std::uint32_t target;
+
+  auto operator<=>(const csr_edge &other) const = default;
+};
+
+// Loads a CSR file in O(1) by mapping it into memory.
+struct csr_graph_view {
+public:
+  csr_graph_view(const std::string &filename) : file_(filename) {
+    if (file_.size() < sizeof(csr_header) ||
+        std::memcmp(file_.data(), kCSRMagic, sizeof(kCSRMagic)) != 0) {
+      std::cerr << "Invalid graph file: " << filename << std::endl;
+      std::exit(-1);
+    }
+    header_ = file_.at<csr_header>(0);
+  }
+
+  auto node_count() const -> std::uint64_t { return header_->node_count; }
+  auto edge_count() const -> std::uint64_t { return header_->edge_count; }
+
+  auto entity_id(std::uint32_t node) const -> std::uint64_t {
+    return nodes()[node];
+  }
+
+  // NOTE looks up the dense node id of a tagged entity id in O(log n).
+  auto find_node(std::uint64_t entity_id) const
+      -> std::optional<std::uint32_t> {
+    const std::span<const std::uint64_t> ids = nodes();
+    const auto it = std::lower_bound(ids.begin(), ids.end(), entity_id);
+    if (it == ids.end() || *it != entity_id) {
+      return std::nullopt;
+    }
+    return it - ids.begin();
+  }
+
+  auto edges(std::uint32_t node) const -> std::span<const csr_edge> {
+    const std::uint64_t *offsets =
+        file_.at<std::uint64_t>(header_->offsets_offset);
+    return {file_.at<csr_edge>(header_->edges_offset) + offsets[node],
+            file_.at<csr_edge>(header_->edges_offset) + offsets[node + 1]};
+  }
+
+private:
+  auto nodes() const -> std::span<const std::uint64_t> {
+    return {file_.at<std::uint64_t>(header_->nodes_offset),
+            header_->node_count};
+  }
+
+  mmap_file file_;
+  const csr_header *header_;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_CSR_GRAPH_H
@@ -0,0 +1,371 @@
+#ifndef UTILS_EXTERNAL_SORT_H
+#define UTILS_EXTERNAL_SORT_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace wd_migrate::utils {
+struct sort_key_t {
+  std::uint64_t hi, lo;
+
+  auto operator<=>(const sort_key_t &other) const = default;
+};
+
+namespace detail {
+struct sort_record {
+  sort_key_t key;
+  std::uint64_t offset;
+  std::uint64_t length;
+};
+
+// Returns the i-th least significant byte of the (hi, lo) key.
+inline auto key_byte(const sort_key_t &key, int index) -> std::uint8_t {
+  return index < 8 ? (key.lo >> (8 * index)) & 0xFF
+                   : (key.hi >> (8 * (index - 8))) & 0xFF;
+}
+
+// Stable LSD radix sort on the 16 key bytes.
+// NOTE bytes that are equal across all records are skipped, e.g., the prefix
+//      character of tagged entity ids.
+inline auto radix_sort(sort_record *begin, sort_record *end,
+                       sort_record *buffer) -> void {
+  const std::uint64_t size = end - begin;
+  if (size <= 1) {
+    return;
+  }
+  sort_key_t all_and{~0ULL, ~0ULL}, all_or{0, 0};
+  for (const sort_record *record = begin; record != end; ++record) {
+    all_and.hi &= record->key.hi, all_and.lo &= record->key.lo;
+    all_or.hi |= record->key.hi, all_or.lo |= record->key.lo;
+  }
+  const sort_key_t varying{all_and.hi ^ all_or.hi, all_and.lo ^ all_or.lo};
+  sort_record *from = begin, *to = buffer;
+  for (int index = 0; index < 16; ++index) {
+    if (key_byte(varying, index) == 0) {
+      continue;
+    }
+    std::array<std::uint64_t, 256> offsets{};
+    for (std::uint64_t i = 0; i < size; ++i) {
+      ++offsets[key_byte(from[i].key, index)];
+    }
+    std::uint64_t sum = 0;
+    for (std::uint64_t &offset : offsets) {
+      sum += std::exchange(offset, sum);
+    }
+    for (std::uint64_t i = 0; i < size; ++i) {
+      to[offsets[key_byte(from[i].key, index)]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != begin) {
+    std::copy(from, from + size, begin);
+  }
+}
+
+// Sequential writer of a spilled run.
+// NOTE records are stored as (key.hi, key.lo, length, bytes).
+struct run_writer {
+public:
+  run_writer(const std::string &filename)
+      : filename_(filename), output_(filename, std::ios::binary) {
+    if (!output_.is_open()) {
+      throw std::runtime_error("Failed to create sorted run: " + filename);
+    }
+  }
+
+  auto write(const sort_key_t &key, const std::string_view line) -> void {
+    const std::uint64_t length = line.size();
+    output_.write(reinterpret_cast<const char *>(&key.hi), sizeof(key.hi));
+    output_.write(reinterpret_cast<const char *>(&key.lo), sizeof(key.lo));
+    output_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    output_.write(line.data(), length);
+  }
+
+  // NOTE a full disk only surfaces once the buffered records are flushed.
+  auto close() -> void {
+    output_.close();
+    if (output_.fail()) {
+      throw std::runtime_error("Failed to write sorted run: " + filename_);
+    }
+  }
+
+private:
+  std::string filename_;
+  std::ofstream output_;
+};
+
+// Sequential reader of a spilled run (see run_writer).
+struct run_reader {
+public:
+  run_reader(const std::string &filename)
+      : filename_(filename), input_(filename, std::ios::binary) {
+    if (!input_.is_open()) {
+      throw std::runtime_error("Failed to open sorted run: " + filename);
+    }
+    next();
+  }
+
+  // NOTE the end of the run must fall on a record boundary, anything else
+  //      (e.g., a truncated run) is an error.
+  auto next() -> void {
+    if (input_.peek() == std::ifstream::traits_type::eof() && input_.eof() &&
+        !input_.bad()) {
+      exhausted_ = true;
+      return;
+    }
+    std::uint64_t length;
+    input_.read(reinterpret_cast<char *>(&key_.hi), sizeof(key_.hi));
+    input_.read(reinterpret_cast<char *>(&key_.lo), sizeof(key_.lo));
+    input_.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (input_) {
+      line_.resize(length);
+      input_.read(line_.data(), length);
+    }
+    if (!input_) {
+      throw std::runtime_error("Failed to read sorted run: " + filename_);
+    }
+  }
+
+  auto exhausted() const -> bool { return exhausted_; }
+  auto key() const -> const sort_key_t & { return key_; }
+  auto line() const -> const std::string & { return line_; }
+
+private:
+  std::string filename_;
+  std::ifstream input_;
+  sort_key_t key_;
+  std::string line_;
+  bool exhausted_ = false;
+};
+
+// Tournament tree of losers over the current records of k runs.
+// NOTE ties are broken by run index, which keeps the merge stable.
+struct loser_tree {
+public:
+  loser_tree(std::vector<std::unique_ptr<run_reader>> &runs)
+      : runs_(runs), losers_(std::max<std::uint64_t>(runs.size(), 1)) {
+    winner_ = runs_.empty() ? 0 : build(1);
+  }
+
+  auto empty() const -> bool {
+    return runs_.empty() || runs_[winner_]->exhausted();
+  }
+  auto top() -> run_reader & { return *runs_[winner_]; }
+
+  // Advances the winning run and replays its path to the root.
+  auto pop() -> void {
+    runs_[winner_]->next();
+    std::uint64_t winner = winner_;
+    for (std::uint64_t node = (winner + runs_.size()) / 2; node >= 1;
+         node /= 2) {
+      if (less(losers_[node], winner)) {
+        std::swap(losers_[node], winner);
+      }
+    }
+    winner_ = winner;
+  }
+
+private:
+  auto build(std::uint64_t node) -> std::uint64_t {
+    if (node >= runs_.size()) {
+      return node - runs_.size();
+    }
+    const std::uint64_t lhs = build(2 * node), rhs = build(2 * node + 1);
+    if (less(rhs, lhs)) {
+      losers_[node] = lhs;
+      return rhs;
+    }
+    losers_[node] = rhs;
+    return lhs;
+  }
+
+  auto less(std::uint64_t lhs, std::uint64_t rhs) const -> bool {
+    const run_reader &a = *runs_[lhs], &b = *runs_[rhs];
+    if (a.exhausted() || b.exhausted()) {
+      return !a.exhausted();
+    }
+    return a.key() < b.key() || (a.key() == b.key() && lhs < rhs);
+  }
+
+  std::vector<std::unique_ptr<run_reader>> &runs_;
+  std::vector<std::uint64_t> losers_;
+  std::uint64_t winner_;
+};
+} // namespace detail
+
+// Sorts lines by integer keys within a bounded memory budget.
+// Lines are buffered until the budget is exhausted, sorted by one radix sort
+// per thread, merged in memory and spilled as one sorted run to a temporary
+// file. The runs are k-way merged into the output once all lines have been
+// added.
+// NOTE lines with equal keys keep their insertion order.
+// NOTE failing to write or read a run throws std::runtime_error.
+struct external_sorter {
+public:
+  // NOTE bounds the number of runs open at once, more runs are first merged
+  //      into fewer runs in additional passes.
+  static constexpr std::uint64_t kMaxFanIn = 64;
+
+  external_sorter(const std::string &temp_prefix, std::uint64_t memory_budget,
+                  unsigned thread_count)
+      : temp_prefix_(temp_prefix), memory_budget_(memory_budget),
+        thread_count_(std::max(1u, thread_count)) {}
+
+  auto add(const sort_key_t &key, const std::string_view line) -> void {
+    records_.push_back(detail::sort_record{
+        .key = key, .offset = arena_.size(), .length = line.size()});
+    arena_.append(line);
+    // NOTE the radix sort requires a second buffer of records.
+    if (arena_.size() + 2 * sizeof(detail::sort_record) * records_.size() >=
+        memory_budget_) {
+      spill();
+    }
+  }
+
+  // Merges all runs into output and removes the temporary files.
+  // NOTE on_line(key, line) is called for every line in output order.
+  template <typename line_fn>
+  auto finish(std::ostream &output, line_fn &&on_line) -> void {
+    if (!records_.empty()) {
+      spill();
+    }
+    const std::uint64_t run_count = run_filenames_.size();
+    std::uint64_t pass_count = 1;
+    for (; run_filenames_.size() > kMaxFanIn; ++pass_count) {
+      merge_pass();
+    }
+    merge(run_filenames_, [&](const sort_key_t &key, const std::string &line) {
+      on_line(key, line);
+      output << line;
+    });
+    std::cout << "external sort: merged " << run_count << " runs in "
+              << pass_count << " passes" << std::endl;
+    run_filenames_.clear();
+  }
+
+  auto finish(std::ostream &output) -> void {
+    finish(output, [](const sort_key_t &, const std::string &) {});
+  }
+
+private:
+  // NOTE the slices are merged pairwise (one merge per thread) until a
+  //      single sorted slice remains, i.e., every spill writes one run.
+  auto spill() -> void {
+    const std::uint64_t size = records_.size();
+    std::vector<detail::sort_record> buffer(size);
+    const std::uint64_t slice_count =
+        std::min<std::uint64_t>(thread_count_, size);
+    const std::uint64_t slice_size = (size + slice_count - 1) / slice_count;
+    parallel_for(slice_size, [&](std::uint64_t begin, std::uint64_t end) {
+      detail::radix_sort(records_.data() + begin, records_.data() + end,
+                         buffer.data() + begin);
+    });
+    detail::sort_record *from = records_.data(), *to = buffer.data();
+    for (std::uint64_t width = slice_size; width < size; width *= 2) {
+      parallel_for(2 * width, [&](std::uint64_t begin, std::uint64_t end) {
+        const std::uint64_t middle = std::min(begin + width, end);
+        // NOTE std::merge prefers the left slice on ties, which keeps the
+        //      insertion order of equal keys.
+        std::merge(from + begin, from + middle, from + middle, from + end,
+                   to + begin,
+                   [](const detail::sort_record &lhs,
+                      const detail::sort_record &rhs) {
+                     return lhs.key < rhs.key;
+                   });
+      });
+      std::swap(from, to);
+    }
+    run_filenames_.push_back(next_run_filename());
+    detail::run_writer run(run_filenames_.back());
+    for (const detail::sort_record *record = from; record != from + size;
+         ++record) {
+      run.write(record->key,
+                std::string_view(arena_.data() + record->offset,
+                                 record->length));
+    }
+    run.close();
+    records_.clear();
+    arena_.clear();
+  }
+
+  // Calls fn(begin, end) for consecutive ranges of (at most) step records,
+  // each on its own thread.
+  template <typename range_fn>
+  auto parallel_for(std::uint64_t step, range_fn &&fn) const -> void {
+    std::vector<std::thread> workers;
+    for (std::uint64_t begin = 0; begin < records_.size(); begin += step) {
+      workers.emplace_back(
+          fn, begin, std::min<std::uint64_t>(begin + step, records_.size()));
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Merges every kMaxFanIn consecutive runs into one.
+  // NOTE merging consecutive runs keeps the insertion order of equal keys.
+  auto merge_pass() -> void {
+    std::vector<std::string> merged_filenames;
+    for (std::uint64_t begin = 0; begin < run_filenames_.size();
+         begin += kMaxFanIn) {
+      const std::uint64_t end =
+          std::min<std::uint64_t>(begin + kMaxFanIn, run_filenames_.size());
+      merged_filenames.push_back(next_run_filename());
+      detail::run_writer run(merged_filenames.back());
+      merge({run_filenames_.begin() + begin, run_filenames_.begin() + end},
+            [&](const sort_key_t &key, const std::string &line) {
+              run.write(key, line);
+            });
+      run.close();
+    }
+    run_filenames_ = std::move(merged_filenames);
+  }
+
+  // Calls on_line(key, line) for the lines of runs in sorted order and
+  // removes the runs afterwards.
+  template <typename line_fn>
+  static auto merge(const std::vector<std::string> &filenames,
+                    line_fn &&on_line) -> void {
+    std::vector<std::unique_ptr<detail::run_reader>> runs;
+    for (const std::string &filename : filenames) {
+      runs.push_back(std::make_unique<detail::run_reader>(filename));
+    }
+    detail::loser_tree tree(runs);
+    for (; !tree.empty(); tree.pop()) {
+      on_line(tree.top().key(), tree.top().line());
+    }
+    runs.clear();
+    for (const std::string &filename : filenames) {
+      std::filesystem::remove(filename);
+    }
+  }
+
+  // NOTE runs are numbered across passes, so merged runs never overwrite
+  //      the runs they are merged from.
+  auto next_run_filename() -> std::string {
+    return temp_prefix_ + ".run" + std::to_string(run_count_++);
+  }
+
+  std::string temp_prefix_;
+  std::uint64_t memory_budget_;
+  unsigned thread_count_;
+
+  std::string arena_;
+  std::vector<detail::sort_record> records_;
+  std::vector<std::string> run_filenames_;
+  std::uint64_t run_count_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_EXTERNAL_SORT_H
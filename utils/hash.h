@@ -0,0 +1,88 @@
+#ifndef UTILS_HASH_H
+#define UTILS_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace wd_migrate::utils {
+struct hash128_t {
+  std::uint64_t hi, lo;
+
+  auto operator==(const hash128_t &other) const -> bool = default;
+};
+
+namespace detail {
+inline auto rotl64(std::uint64_t x, int r) -> std::uint64_t {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline auto fmix64(std::uint64_t k) -> std::uint64_t {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+} // namespace detail
+
+// MurmurHash3 (x64, 128-bit variant) by Austin Appleby (public domain).
+inline auto hash128(const std::string_view key, std::uint64_t seed = 0)
+    -> hash128_t {
+  using detail::fmix64;
+  using detail::rotl64;
+  const char *data = key.data();
+  const std::uint64_t len = key.size();
+  const std::uint64_t nblocks = len / 16;
+
+  std::uint64_t h1 = seed, h2 = seed;
+  constexpr std::uint64_t c1 = 0x87c37b91114253d5ULL;
+  constexpr std::uint64_t c2 = 0x4cf5ad432745937fULL;
+
+  for (std::uint64_t i = 0; i < nblocks; ++i) {
+    std::uint64_t k1, k2;
+    std::memcpy(&k1, data + 16 * i, sizeof(k1));
+    std::memcpy(&k2, data + 16 * i + 8, sizeof(k2));
+
+    k1 *= c1, k1 = rotl64(k1, 31), k1 *= c2, h1 ^= k1;
+    h1 = rotl64(h1, 27), h1 += h2, h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2, k2 = rotl64(k2, 33), k2 *= c1, h2 ^= k2;
+    h2 = rotl64(h2, 31), h2 += h1, h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const auto *tail =
+      reinterpret_cast<const std::uint8_t *>(data + 16 * nblocks);
+  std::uint64_t k1 = 0, k2 = 0;
+  switch (len & 15) {
+  case 15: k2 ^= std::uint64_t(tail[14]) << 48; [[fallthrough]];
+  case 14: k2 ^= std::uint64_t(tail[13]) << 40; [[fallthrough]];
+  case 13: k2 ^= std::uint64_t(tail[12]) << 32; [[fallthrough]];
+  case 12: k2 ^= std::uint64_t(tail[11]) << 24; [[fallthrough]];
+  case 11: k2 ^= std::uint64_t(tail[10]) << 16; [[fallthrough]];
+  case 10: k2 ^= std::uint64_t(tail[9]) << 8; [[fallthrough]];
+  case 9:
+    k2 ^= std::uint64_t(tail[8]);
+    k2 *= c2, k2 = rotl64(k2, 33), k2 *= c1, h2 ^= k2;
+    [[fallthrough]];
+  case 8: k1 ^= std::uint64_t(tail[7]) << 56; [[fallthrough]];
+  case 7: k1 ^= std::uint64_t(tail[6]) << 48; [[fallthrough]];
+  case 6: k1 ^= std::uint64_t(tail[5]) << 40; [[fallthrough]];
+  case 5: k1 ^= std::uint64_t(tail[4]) << 32; [[fallthrough]];
+  case 4: k1 ^= std::uint64_t(tail[3]) << 24; [[fallthrough]];
+  case 3: k1 ^= std::uint64_t(tail[2]) << 16; [[fallthrough]];
+  case 2: k1 ^= std::uint64_t(tail[1]) << 8; [[fallthrough]];
+  case 1:
+    k1 ^= std::uint64_t(tail[0]);
+    k1 *= c1, k1 = rotl64(k1, 31), k1 *= c2, h1 ^= k1;
+  }
+
+  h1 ^= len, h2 ^= len;
+  h1 += h2, h2 += h1;
+  h1 = fmix64(h1), h2 = fmix64(h2);
+  h1 += h2, h2 += h1;
+  return hash128_t{.hi = h1, .lo = h2};
+}
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_HASH_H
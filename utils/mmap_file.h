@@ -0,0 +1,64 @@
+#ifndef UTILS_MMAP_FILE_H
+#define UTILS_MMAP_FILE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wd_migrate::utils {
+// Read-only memory mapping of an entire file.
+struct mmap_file {
+public:
+  mmap_file(const std::string &filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || ::fstat(fd, &status) != 0) {
+      std::cerr << "Failed to open file: " << filename << std::endl;
+      std::exit(-1);
+    }
+    size_ = status.st_size;
+    if (size_ != 0) {
+      void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << filename << std::endl;
+        std::exit(-1);
+      }
+      data_ = static_cast<const char *>(data);
+    }
+    ::close(fd);
+  }
+
+  mmap_file(mmap_file &&other)
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  mmap_file(const mmap_file &) = delete;
+  auto operator=(const mmap_file &) -> mmap_file & = delete;
+
+  ~mmap_file() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  auto data() const -> const char * { return data_; }
+  auto size() const -> std::uint64_t { return size_; }
+
+  template <typename type>
+  auto at(std::uint64_t offset) const -> const type * {
+    return reinterpret_cast<const type *>(data_ + offset);
+  }
+
+private:
+  const char *data_ = nullptr;
+  std::uint64_t size_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_MMAP_FILE_H
@@ -0,0 +1,90 @@
+#ifndef UTILS_MPMC_RING_H
+#define UTILS_MPMC_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Bounded FIFO between any number of producer and consumer threads. push
+// blocks while the ring is full, pop blocks while it is empty.
+// NOTE every push and pop claims a position with a single fetch_add and then
+//      waits (std::atomic::wait) on the sequence number of its slot, i.e.,
+//      there are no locks and contended positions never retry.
+// NOTE there is no close(), producers signal the end of the input in-band
+//      (e.g., through one sentinel value per consumer).
+template <typename value_type> class mpmc_ring {
+public:
+  mpmc_ring(std::uint64_t capacity) : slots_(capacity) {
+    for (std::uint64_t index = 0; index < capacity; ++index) {
+      slots_[index].sequence.store(index, std::memory_order_relaxed);
+    }
+  }
+
+  auto push(value_type value) -> void {
+    const std::uint64_t position =
+        tail_.fetch_add(1, std::memory_order_relaxed);
+    slot &target = slots_[position % slots_.size()];
+    wait_for(target.sequence, position);
+    target.value = std::move(value);
+    target.sequence.store(position + 1, std::memory_order_release);
+    target.sequence.notify_all();
+  }
+
+  auto pop() -> value_type {
+    const std::uint64_t position =
+        head_.fetch_add(1, std::memory_order_relaxed);
+    slot &source = slots_[position % slots_.size()];
+    wait_for(source.sequence, position + 1);
+    value_type value = std::move(source.value);
+    source.sequence.store(position + slots_.size(), std::memory_order_release);
+    source.sequence.notify_all();
+    return value;
+  }
+
+  // NOTE returns std::nullopt instead of blocking if the value at the head
+  //      has not been pushed yet.
+  auto try_pop() -> std::optional<value_type> {
+    std::uint64_t position = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      slot &source = slots_[position % slots_.size()];
+      if (source.sequence.load(std::memory_order_acquire) != position + 1) {
+        return std::nullopt;
+      }
+      if (head_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        value_type value = std::move(source.value);
+        source.sequence.store(position + slots_.size(),
+                              std::memory_order_release);
+        source.sequence.notify_all();
+        return value;
+      }
+    }
+  }
+
+private:
+  // NOTE the sequence of the slot of position is position while the slot is
+  //      free and position + 1 once it holds the value pushed at position.
+  struct slot {
+    alignas(64) std::atomic<std::uint64_t> sequence;
+    value_type value;
+  };
+
+  static auto wait_for(const std::atomic<std::uint64_t> &sequence,
+                       std::uint64_t expected) -> void {
+    for (std::uint64_t current = sequence.load(std::memory_order_acquire);
+         current != expected;
+         current = sequence.load(std::memory_order_acquire)) {
+      sequence.wait(current, std::memory_order_acquire);
+    }
+  }
+
+  std::vector<slot> slots_;
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_MPMC_RING_H
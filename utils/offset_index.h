@@ -0,0 +1,122 @@
+#ifndef UTILS_OFFSET_INDEX_H
+#define UTILS_OFFSET_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "mmap_file.h"
+
+namespace wd_migrate::utils {
+// Sidecar index of an entity-grouped output file.
+// Layout (little-endian):
+//   offset_index_header
+//   entries: entry_count x offset_index_entry, sorted by (entity_id, offset).
+// NOTE an entity may have more than one entry if its rows are not contiguous.
+static constexpr char kOffsetIndexMagic[8] = {'W', 'D', 'I', 'D',
+                                              'X', '0', '0', '1'};
+
+struct offset_index_header {
+  char magic[8];
+  std::uint64_t entry_count;
+};
+
+struct offset_index_entry {
+  // NOTE the tagged entity id (see encode_entity_id).
+  std::uint64_t entity_id;
+  // NOTE byte offset of the first row within the output file.
+  std::uint64_t offset;
+  std::uint64_t row_count;
+
+  auto operator<=>(const offset_index_entry &other) const = default;
+};
+
+// Collects the entries while the output is written.
+// NOTE entries are kept in memory (24 bytes per entity) and sorted on write,
+//      unless they were added in order.
+struct offset_index_writer {
+public:
+  auto add(std::uint64_t entity_id, std::uint64_t offset,
+           std::uint64_t row_count) -> void {
+    const offset_index_entry entry{
+        .entity_id = entity_id, .offset = offset, .row_count = row_count};
+    sorted_ &= (entries_.empty() || !(entry < entries_.back()));
+    entries_.push_back(entry);
+  }
+
+  auto write(const std::string &filename) -> void {
+    if (!sorted_) {
+      std::sort(entries_.begin(), entries_.end());
+      sorted_ = true;
+    }
+    offset_index_header header;
+    std::copy(std::begin(kOffsetIndexMagic), std::end(kOffsetIndexMagic),
+              header.magic);
+    header.entry_count = entries_.size();
+    std::ofstream output(filename, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(entries_.data()),
+                 sizeof(offset_index_entry) * entries_.size());
+  }
+
+  auto size() const -> std::uint64_t { return entries_.size(); }
+
+  auto save_checkpoint(checkpoint_writer &writer) const -> void {
+    writer.write(entries_);
+    writer.write(sorted_);
+  }
+
+  auto load_checkpoint(checkpoint_reader &reader) -> void {
+    reader.read(entries_);
+    reader.read(sorted_);
+  }
+
+private:
+  std::vector<offset_index_entry> entries_;
+  bool sorted_ = true;
+};
+
+// Looks up entries of a memory-mapped index in O(log n).
+struct offset_index_view {
+public:
+  offset_index_view(const std::string &filename) : file_(filename) {
+    if (file_.size() < sizeof(offset_index_header) ||
+        std::memcmp(file_.data(), kOffsetIndexMagic,
+                    sizeof(kOffsetIndexMagic)) != 0) {
+      std::cerr << "Invalid index file: " << filename << std::endl;
+      std::exit(-1);
+    }
+    entries_ = {file_.at<offset_index_entry>(sizeof(offset_index_header)),
+                file_.at<offset_index_header>(0)->entry_count};
+  }
+
+  auto find(std::uint64_t entity_id) const
+      -> std::span<const offset_index_entry> {
+    const auto begin = std::lower_bound(
+        entries_.begin(), entries_.end(), entity_id,
+        [](const offset_index_entry &entry, std::uint64_t id) {
+          return entry.entity_id < id;
+        });
+    auto end = begin;
+    while (end != entries_.end() && end->entity_id == entity_id) {
+      ++end;
+    }
+    return {begin, end};
+  }
+
+  auto size() const -> std::uint64_t { return entries_.size(); }
+
+private:
+  mmap_file file_;
+  std::span<const offset_index_entry> entries_;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_OFFSET_INDEX_H
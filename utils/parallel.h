@@ -0,0 +1,35 @@
+#ifndef UTILS_PARALLEL_H
+#define UTILS_PARALLEL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace wd_migrate::utils {
+inline auto default_thread_count() -> unsigned {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Splits [0, count) into one contiguous range per thread and calls
+// fn(thread_index, begin, end) for each of them concurrently.
+template <typename range_fn>
+auto parallel_for(std::uint64_t count, unsigned thread_count, range_fn &&fn)
+    -> void {
+  thread_count = std::max<std::uint64_t>(
+      1, std::min<std::uint64_t>(thread_count, count));
+  const std::uint64_t range_size = (count + thread_count - 1) / thread_count;
+  std::vector<std::thread> workers;
+  for (unsigned thread = 0; thread < thread_count; ++thread) {
+    const std::uint64_t begin = std::min(count, thread * range_size);
+    const std::uint64_t end = std::min(count, begin + range_size);
+    workers.emplace_back(
+        [&fn, thread, begin, end]() { fn(thread, begin, end); });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_PARALLEL_H
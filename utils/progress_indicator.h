@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <string>
 
 namespace wd_migrate::utils {
@@ -28,6 +29,7 @@ public:
     }
   }
   auto done() -> void {
+    std::lock_guard lock(output_mutex_);
     std::cout << label_ << " took ";
     print_time_millis(elapsed_millis());
     std::cout << std::string(20, ' ') << std::endl;
@@ -35,6 +37,7 @@ public:
 
 private:
   auto print_progress() -> void {
+    std::lock_guard lock(output_mutex_);
     std::uint64_t it_per_second =
         1000.0 * (double)iterations_ / elapsed_millis();
     std::cout << "| " << label_ << ": " << iterations_ << " it "
@@ -59,6 +62,9 @@ private:
               << ":" << std::setw(3) << milliseconds;
   }
 
+  // NOTE several parsers may report progress concurrently.
+  static inline std::mutex output_mutex_;
+
   const std::string label_;
   std::uint64_t iterations_ = 0;
   std::chrono::time_point<std::chrono::steady_clock> start_;
@@ -0,0 +1,109 @@
+#ifndef UTILS_QUARANTINE_H
+#define UTILS_QUARANTINE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "checkpoint.h"
+
+namespace wd_migrate::utils {
+struct quarantine_options {
+  // NOTE malformed rows abort the conversion if filename is empty.
+  std::string filename;
+  // NOTE the conversion is aborted once more than this fraction of the rows
+  //      read so far is malformed.
+  double max_error_rate = 0.001;
+};
+
+// Dead-letter file of the rows that could not be parsed, one per line:
+//   <input line>\t<reason>\t<fields of the row...>
+// NOTE at most kMaxWrittenRows rows are written, later rows are only counted.
+class quarantine {
+public:
+  auto open(const quarantine_options &options, bool resume) -> void {
+    options_ = options;
+    if (enabled()) {
+      output_ = std::make_unique<std::ofstream>(
+          options_.filename, resume ? std::ios::app : std::ios::trunc);
+    }
+  }
+
+  auto enabled() const -> bool { return !options_.filename.empty(); }
+
+  // NOTE row_count is the number of rows read so far, including this one.
+  template <typename... field_types>
+  auto add(std::uint64_t row_count, std::uint64_t line,
+           const std::string_view reason, const field_types &...fields)
+      -> void {
+    if (!enabled()) {
+      std::cerr << "Malformed row in line " << line << ": " << reason;
+      ((std::cerr << "\t" << fields), ...);
+      std::cerr << std::endl;
+      std::exit(-1);
+    }
+    ++error_count_;
+    if (written_count_ < kMaxWrittenRows) {
+      *output_ << line << "\t" << reason;
+      ((*output_ << "\t" << fields), ...);
+      *output_ << "\n";
+      ++written_count_;
+    }
+    // NOTE the rate is only meaningful once enough rows have been read.
+    const std::uint64_t rows = std::max(row_count, kMinimumRowCount);
+    if (error_count_ > options_.max_error_rate * rows) {
+      std::cerr << "Too many malformed rows: " << error_count_ << " of "
+                << row_count << " (see " << options_.filename << ")"
+                << std::endl;
+      std::exit(-1);
+    }
+  }
+
+  auto summary() -> void {
+    if (enabled()) {
+      std::cout << "quarantined rows: " << error_count_ << " (written: "
+                << written_count_ << ")" << std::endl;
+      output_->flush();
+    }
+  }
+
+  auto save_checkpoint(checkpoint_writer &writer) -> void {
+    if (enabled()) {
+      output_->flush();
+      writer.write<std::uint64_t>(
+          std::filesystem::file_size(options_.filename));
+      writer.write(error_count_);
+      writer.write(written_count_);
+    }
+  }
+
+  // NOTE drops the rows quarantined after the checkpoint was taken.
+  auto load_checkpoint(checkpoint_reader &reader) -> void {
+    if (enabled()) {
+      std::uint64_t size;
+      reader.read(size);
+      output_->close();
+      std::filesystem::resize_file(options_.filename, size);
+      output_->open(options_.filename, std::ios::app);
+      reader.read(error_count_);
+      reader.read(written_count_);
+    }
+  }
+
+private:
+  static constexpr std::uint64_t kMaxWrittenRows = 100'000;
+  static constexpr std::uint64_t kMinimumRowCount = 100'000;
+
+  quarantine_options options_;
+  std::unique_ptr<std::ofstream> output_;
+  std::uint64_t error_count_ = 0, written_count_ = 0;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_QUARANTINE_H
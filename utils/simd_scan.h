@@ -0,0 +1,149 @@
+#ifndef UTILS_SIMD_SCAN_H
+#define UTILS_SIMD_SCAN_H
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace wd_migrate::utils {
+// Predicate kernels over blocks of (up to) kScanBlockSize fixed-width values,
+// returning a bitmask of the matching values (bit i for values[i]).
+// NOTE full blocks are evaluated with AVX2 if the CPU supports it (checked at
+//      runtime, so no -mavx2 is required), otherwise with scalar loops.
+static constexpr std::uint64_t kScanBlockSize = 64;
+
+namespace detail {
+#if defined(__x86_64__)
+inline auto has_avx2() -> bool {
+  static const bool kHasAVX2 = __builtin_cpu_supports("avx2");
+  return kHasAVX2;
+}
+
+__attribute__((target("avx2"))) inline auto
+avx2_equal_u8(const std::uint8_t *values, std::uint8_t needle)
+    -> std::uint64_t {
+  const __m256i key = _mm256_set1_epi8(static_cast<char>(needle));
+  std::uint64_t mask = 0;
+  for (std::uint64_t index = 0; index < kScanBlockSize; index += 32) {
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(values + index));
+    mask |= std::uint64_t(static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, key))))
+            << index;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) inline auto
+avx2_equal_u32(const std::uint32_t *values, std::uint32_t needle)
+    -> std::uint64_t {
+  const __m256i key = _mm256_set1_epi32(static_cast<int>(needle));
+  std::uint64_t mask = 0;
+  for (std::uint64_t index = 0; index < kScanBlockSize; index += 8) {
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(values + index));
+    mask |= std::uint64_t(_mm256_movemask_ps(
+                _mm256_castsi256_ps(_mm256_cmpeq_epi32(block, key))))
+            << index;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) inline auto
+avx2_equal_u64(const std::uint64_t *values, std::uint64_t needle)
+    -> std::uint64_t {
+  const __m256i key = _mm256_set1_epi64x(static_cast<long long>(needle));
+  std::uint64_t mask = 0;
+  for (std::uint64_t index = 0; index < kScanBlockSize; index += 4) {
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(values + index));
+    mask |= std::uint64_t(_mm256_movemask_pd(
+                _mm256_castsi256_pd(_mm256_cmpeq_epi64(block, key))))
+            << index;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) inline auto
+avx2_range_i64(const std::int64_t *values, std::int64_t lo, std::int64_t hi)
+    -> std::uint64_t {
+  const __m256i lower = _mm256_set1_epi64x(lo), upper = _mm256_set1_epi64x(hi);
+  std::uint64_t outside = 0;
+  for (std::uint64_t index = 0; index < kScanBlockSize; index += 4) {
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(values + index));
+    const __m256i miss = _mm256_or_si256(_mm256_cmpgt_epi64(lower, block),
+                                         _mm256_cmpgt_epi64(block, upper));
+    outside |= std::uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(miss)))
+               << index;
+  }
+  return ~outside;
+}
+#else
+inline auto has_avx2() -> bool { return false; }
+#endif
+
+template <typename value_type, typename predicate_fn>
+auto scalar_mask(const value_type *values, std::uint64_t count,
+                 predicate_fn &&predicate) -> std::uint64_t {
+  std::uint64_t mask = 0;
+  for (std::uint64_t index = 0; index < count; ++index) {
+    mask |= std::uint64_t(predicate(values[index])) << index;
+  }
+  return mask;
+}
+} // namespace detail
+
+inline auto scan_equal(const std::uint8_t *values, std::uint64_t count,
+                       std::uint8_t needle) -> std::uint64_t {
+#if defined(__x86_64__)
+  if (count == kScanBlockSize && detail::has_avx2()) {
+    return detail::avx2_equal_u8(values, needle);
+  }
+#endif
+  return detail::scalar_mask(values, count, [needle](std::uint8_t value) {
+    return value == needle;
+  });
+}
+
+inline auto scan_equal(const std::uint32_t *values, std::uint64_t count,
+                       std::uint32_t needle) -> std::uint64_t {
+#if defined(__x86_64__)
+  if (count == kScanBlockSize && detail::has_avx2()) {
+    return detail::avx2_equal_u32(values, needle);
+  }
+#endif
+  return detail::scalar_mask(values, count, [needle](std::uint32_t value) {
+    return value == needle;
+  });
+}
+
+inline auto scan_equal(const std::uint64_t *values, std::uint64_t count,
+                       std::uint64_t needle) -> std::uint64_t {
+#if defined(__x86_64__)
+  if (count == kScanBlockSize && detail::has_avx2()) {
+    return detail::avx2_equal_u64(values, needle);
+  }
+#endif
+  return detail::scalar_mask(values, count, [needle](std::uint64_t value) {
+    return value == needle;
+  });
+}
+
+// NOTE matches lo <= value <= hi.
+inline auto scan_range(const std::int64_t *values, std::uint64_t count,
+                       std::int64_t lo, std::int64_t hi) -> std::uint64_t {
+#if defined(__x86_64__)
+  if (count == kScanBlockSize && detail::has_avx2()) {
+    return detail::avx2_range_i64(values, lo, hi);
+  }
+#endif
+  return detail::scalar_mask(values, count, [lo, hi](std::int64_t value) {
+    return lo <= value && value <= hi;
+  });
+}
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_SIMD_SCAN_H
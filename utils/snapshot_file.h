@@ -0,0 +1,404 @@
+#ifndef UTILS_SNAPSHOT_FILE_H
+#define UTILS_SNAPSHOT_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mmap_file.h"
+
+namespace wd_migrate::utils {
+// Columnar file of named sections.
+// Layout (little-endian, sections are 8-byte aligned):
+//   snapshot_header
+//   sections: section_count x snapshot_section
+//   section data
+// NOTE columns are stored in one or more sections named <column>.<suffix>,
+//      where the suffix identifies the encoding (see snapshot_column_writer).
+static constexpr char kSnapshotMagic[8] = {'W', 'D', 'S', 'N',
+                                           'P', '0', '0', '1'};
+
+struct snapshot_header {
+  char magic[8];
+  std::uint64_t tag;
+  std::uint64_t row_count;
+  std::uint64_t section_count;
+};
+
+struct snapshot_section {
+  char name[48];
+  std::uint64_t offset, size;
+};
+
+// NOTE sections are streamed to temporary files next to the snapshot, which
+//      are concatenated once all rows have been written.
+class snapshot_writer {
+public:
+  snapshot_writer(const std::string &filename) : filename_(filename) {}
+
+  auto section(const std::string &name) -> std::ofstream & {
+    if (name.size() >= sizeof(snapshot_section::name)) {
+      std::cerr << "Snapshot section name too long: " << name << std::endl;
+      std::exit(-1);
+    }
+    sections_.push_back(
+        {.name = name,
+         .stream = std::make_unique<std::ofstream>(temp_filename(name),
+                                                   std::ios::binary)});
+    return *sections_.back().stream;
+  }
+
+  auto finish(std::uint64_t tag, std::uint64_t row_count) -> void {
+    snapshot_header header;
+    std::copy(std::begin(kSnapshotMagic), std::end(kSnapshotMagic),
+              header.magic);
+    header.tag = tag;
+    header.row_count = row_count;
+    header.section_count = sections_.size();
+
+    std::vector<snapshot_section> table(sections_.size());
+    std::uint64_t offset =
+        sizeof(header) + sizeof(snapshot_section) * table.size();
+    for (std::uint64_t index = 0; index < sections_.size(); ++index) {
+      sections_[index].stream->close();
+      std::memset(table[index].name, 0, sizeof(table[index].name));
+      sections_[index].name.copy(table[index].name,
+                                 sections_[index].name.size());
+      table[index].offset = offset;
+      table[index].size =
+          std::filesystem::file_size(temp_filename(sections_[index].name));
+      offset = align(offset + table[index].size);
+    }
+
+    std::ofstream output(filename_, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(table.data()),
+                 sizeof(snapshot_section) * table.size());
+    for (std::uint64_t index = 0; index < sections_.size(); ++index) {
+      const std::string filename = temp_filename(sections_[index].name);
+      // NOTE streaming an empty buffer sets the failbit of output, i.e.,
+      //      empty sections (e.g., of value types missing from the dump)
+      //      must not be copied.
+      if (table[index].size != 0) {
+        std::ifstream input(filename, std::ios::binary);
+        output << input.rdbuf();
+      }
+      static constexpr char kPadding[8] = {};
+      output.write(kPadding, align(table[index].size) - table[index].size);
+      std::filesystem::remove(filename);
+    }
+    output.close();
+    if (!output.good()) {
+      std::cerr << "Failed to write snapshot: " << filename_ << std::endl;
+      std::exit(-1);
+    }
+    sections_.clear();
+  }
+
+private:
+  static auto align(std::uint64_t offset) -> std::uint64_t {
+    return (offset + 7) & ~std::uint64_t(7);
+  }
+
+  auto temp_filename(const std::string &name) const -> std::string {
+    return filename_ + "." + name;
+  }
+
+  struct section_stream {
+    std::string name;
+    std::unique_ptr<std::ofstream> stream;
+  };
+
+  std::string filename_;
+  std::vector<section_stream> sections_;
+};
+
+enum class snapshot_encoding {
+  // NUL-terminated strings (<name>.offsets, <name>.bytes).
+  plain,
+  // u32 codes into a plain dictionary (<name>.codes, <name>.dict.*).
+  // NOTE code kSnapshotNullCode marks a missing value.
+  dictionary,
+  // Fixed-width integers (<name>.u8, <name>.u64).
+  u8,
+  u64
+};
+
+static constexpr std::uint32_t kSnapshotNullCode = ~std::uint32_t(0);
+
+namespace detail {
+template <typename type>
+auto write_scalar(std::ofstream &output, const type value) -> void {
+  output.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+struct plain_strings_writer {
+  plain_strings_writer(snapshot_writer &file, const std::string &name)
+      : offsets(&file.section(name + ".offsets")),
+        bytes(&file.section(name + ".bytes")) {
+    write_scalar<std::uint64_t>(*offsets, 0);
+  }
+
+  auto push(const std::string_view value) -> void {
+    bytes->write(value.data(), value.size());
+    bytes->put('\0');
+    size += value.size() + 1;
+    write_scalar<std::uint64_t>(*offsets, size);
+  }
+
+  std::ofstream *offsets, *bytes;
+  std::uint64_t size = 0;
+};
+} // namespace detail
+
+// Appends the values of a single column to a snapshot.
+class snapshot_column_writer {
+public:
+  snapshot_column_writer(snapshot_writer &file, const std::string &name,
+                         snapshot_encoding encoding)
+      : encoding_(encoding) {
+    switch (encoding_) {
+    case snapshot_encoding::plain:
+      strings_.emplace(file, name);
+      break;
+    case snapshot_encoding::dictionary:
+      strings_.emplace(file, name + ".dict");
+      values_ = &file.section(name + ".codes");
+      break;
+    case snapshot_encoding::u8:
+      values_ = &file.section(name + ".u8");
+      break;
+    case snapshot_encoding::u64:
+      values_ = &file.section(name + ".u64");
+      break;
+    }
+  }
+
+  auto push(const std::string_view value) -> void {
+    if (encoding_ == snapshot_encoding::plain) {
+      strings_->push(value);
+      return;
+    }
+    auto it = codes_.find(value);
+    if (it == codes_.end()) {
+      it = codes_.emplace(std::string(value), codes_.size()).first;
+      strings_->push(value);
+    }
+    detail::write_scalar<std::uint32_t>(*values_, it->second);
+  }
+
+  // NOTE only supported for dictionary columns.
+  auto push_null() -> void {
+    detail::write_scalar<std::uint32_t>(*values_, kSnapshotNullCode);
+  }
+
+  auto push(std::uint64_t value) -> void {
+    if (encoding_ == snapshot_encoding::u8) {
+      detail::write_scalar<std::uint8_t>(*values_, value);
+    } else {
+      detail::write_scalar<std::uint64_t>(*values_, value);
+    }
+  }
+
+private:
+  struct string_hash {
+    using is_transparent = void;
+    auto operator()(const std::string_view value) const -> std::size_t {
+      return std::hash<std::string_view>{}(value);
+    }
+  };
+
+  snapshot_encoding encoding_;
+  std::optional<detail::plain_strings_writer> strings_;
+  std::ofstream *values_ = nullptr;
+  std::unordered_map<std::string, std::uint32_t, string_hash,
+                     std::equal_to<>>
+      codes_;
+};
+
+// Memory-mapped snapshot.
+class snapshot_file {
+public:
+  snapshot_file(const std::string &filename) : file_(filename) {
+    if (file_.size() < sizeof(snapshot_header) ||
+        std::memcmp(file_.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) !=
+            0) {
+      std::cerr << "Invalid snapshot file: " << filename << std::endl;
+      std::exit(-1);
+    }
+    header_ = file_.at<snapshot_header>(0);
+    validate(filename);
+  }
+
+  // NOTE only reads the magic, so this is cheap for (large) TSV files.
+  static auto is_snapshot(const std::string &filename) -> bool {
+    char magic[sizeof(kSnapshotMagic)];
+    std::ifstream input(filename, std::ios::binary);
+    return input.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0;
+  }
+
+  auto tag() const -> std::uint64_t { return header_->tag; }
+  auto row_count() const -> std::uint64_t { return header_->row_count; }
+
+  template <typename type>
+  auto section(const std::string_view name) const -> const type * {
+    const snapshot_section *entry = find_section(name);
+    return entry != nullptr ? file_.at<type>(entry->offset) : nullptr;
+  }
+
+  // NOTE returns the size of the section in bytes (0 if it is missing).
+  auto section_size(const std::string_view name) const -> std::uint64_t {
+    const snapshot_section *entry = find_section(name);
+    return entry != nullptr ? entry->size : 0;
+  }
+
+private:
+  // NOTE a truncated or corrupt snapshot would otherwise fault (or read
+  //      garbage) once a section is accessed through the mapping.
+  auto validate(const std::string &filename) const -> void {
+    const std::uint64_t table_end =
+        sizeof(snapshot_header) +
+        sizeof(snapshot_section) * header_->section_count;
+    bool valid = header_->section_count <=
+                     (file_.size() - sizeof(snapshot_header)) /
+                         sizeof(snapshot_section) &&
+                 table_end <= file_.size();
+    for (std::uint64_t index = 0; valid && index < header_->section_count;
+         ++index) {
+      const snapshot_section &entry = *file_.at<snapshot_section>(
+          sizeof(snapshot_header) + sizeof(snapshot_section) * index);
+      valid = entry.offset >= table_end && entry.offset <= file_.size() &&
+              entry.size <= file_.size() - entry.offset &&
+              std::memchr(entry.name, '\0', sizeof(entry.name)) != nullptr;
+    }
+    if (!valid) {
+      std::cerr << "Truncated or corrupt snapshot file: " << filename
+                << std::endl;
+      std::exit(-1);
+    }
+  }
+
+  auto find_section(const std::string_view name) const
+      -> const snapshot_section * {
+    const snapshot_section *table =
+        file_.at<snapshot_section>(sizeof(snapshot_header));
+    for (std::uint64_t index = 0; index < header_->section_count; ++index) {
+      if (name == table[index].name) {
+        return &table[index];
+      }
+    }
+    return nullptr;
+  }
+
+  mmap_file file_;
+  const snapshot_header *header_;
+};
+
+// Random access to the values of a single column of a snapshot.
+class snapshot_column_reader {
+public:
+  snapshot_column_reader(const snapshot_file &file, const std::string &name,
+                         snapshot_encoding encoding)
+      : name_(name) {
+    switch (encoding) {
+    case snapshot_encoding::plain:
+      bind_strings(file, name);
+      break;
+    case snapshot_encoding::dictionary:
+      bind_strings(file, name + ".dict");
+      codes_ = bind<std::uint32_t>(file, name + ".codes");
+      break;
+    case snapshot_encoding::u8:
+      u8_ = bind<std::uint8_t>(file, name + ".u8");
+      break;
+    case snapshot_encoding::u64:
+      u64_ = bind<std::uint64_t>(file, name + ".u64");
+      break;
+    }
+  }
+
+  auto has_strings() const -> bool { return bytes_ != nullptr; }
+
+  // NOTE returns nullptr for missing dictionary values.
+  auto c_str(std::uint64_t index) const -> const char * {
+    if (codes_ != nullptr) {
+      const std::uint32_t code = codes_[index];
+      return code == kSnapshotNullCode ? nullptr : bytes_ + offsets_[code];
+    }
+    return bytes_ + offsets_[index];
+  }
+
+  auto view(std::uint64_t index) const -> std::string_view {
+    if (codes_ != nullptr) {
+      index = codes_[index];
+    }
+    return {bytes_ + offsets_[index],
+            offsets_[index + 1] - offsets_[index] - 1};
+  }
+
+  auto scalar(std::uint64_t index) const -> std::uint64_t {
+    return u8_ != nullptr ? u8_[index] : u64_[index];
+  }
+
+  // NOTE the raw values for scans, nullptr unless the column has the
+  //      corresponding encoding.
+  auto codes() const -> const std::uint32_t * { return codes_; }
+  auto u8() const -> const std::uint8_t * { return u8_; }
+  auto u64() const -> const std::uint64_t * { return u64_; }
+
+  // NOTE returns the code of value in the dictionary (if present).
+  auto find_code(const std::string_view value) const
+      -> std::optional<std::uint32_t> {
+    for (std::uint64_t code = 0; codes_ != nullptr && code < string_count_;
+         ++code) {
+      if (std::string_view(bytes_ + offsets_[code],
+                           offsets_[code + 1] - offsets_[code] - 1) ==
+          value) {
+        return code;
+      }
+    }
+    return std::nullopt;
+  }
+
+private:
+  template <typename type>
+  auto bind(const snapshot_file &file, const std::string &section) const
+      -> const type * {
+    const type *data = file.section<type>(section);
+    if (data == nullptr) {
+      std::cerr << "Snapshot is missing column: " << name_ << std::endl;
+      std::exit(-1);
+    }
+    return data;
+  }
+
+  auto bind_strings(const snapshot_file &file, const std::string &name)
+      -> void {
+    offsets_ = bind<std::uint64_t>(file, name + ".offsets");
+    bytes_ = bind<char>(file, name + ".bytes");
+    string_count_ =
+        file.section_size(name + ".offsets") / sizeof(std::uint64_t) - 1;
+  }
+
+  std::string name_;
+  const std::uint64_t *offsets_ = nullptr;
+  const char *bytes_ = nullptr;
+  std::uint64_t string_count_ = 0;
+  const std::uint32_t *codes_ = nullptr;
+  const std::uint8_t *u8_ = nullptr;
+  const std::uint64_t *u64_ = nullptr;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_SNAPSHOT_FILE_H
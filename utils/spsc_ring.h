@@ -0,0 +1,75 @@
+#ifndef UTILS_SPSC_RING_H
+#define UTILS_SPSC_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Bounded lock-free FIFO between exactly one producer and one consumer
+// thread. push blocks while the ring is full, pop blocks while it is empty.
+// NOTE blocking uses std::atomic::wait, i.e., the threads sleep instead of
+//      spinning while the other side is busy.
+// NOTE once the producer calls close(), pop drains the remaining elements and
+//      then returns std::nullopt.
+template <typename value_type> class spsc_ring {
+public:
+  spsc_ring(std::uint64_t capacity) : slots_(capacity) {}
+
+  auto push(value_type value) -> void {
+    const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+    for (std::uint64_t head = head_.load(std::memory_order_acquire);
+         tail - head == slots_.size();
+         head = head_.load(std::memory_order_acquire)) {
+      head_.wait(head, std::memory_order_acquire);
+    }
+    slots_[tail % slots_.size()] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    tail_.notify_one();
+  }
+
+  auto pop() -> std::optional<value_type> {
+    const std::uint64_t head = head_.load(std::memory_order_relaxed);
+    std::uint64_t tail = tail_.load(std::memory_order_acquire);
+    while ((tail & ~kClosed) == head) {
+      if (tail & kClosed) {
+        return std::nullopt;
+      }
+      tail_.wait(tail, std::memory_order_acquire);
+      tail = tail_.load(std::memory_order_acquire);
+    }
+    value_type value = std::move(slots_[head % slots_.size()]);
+    head_.store(head + 1, std::memory_order_release);
+    head_.notify_one();
+    return value;
+  }
+
+  // NOTE returns std::nullopt if the ring is empty (or closed).
+  auto try_pop() -> std::optional<value_type> {
+    const std::uint64_t head = head_.load(std::memory_order_relaxed);
+    if ((tail_.load(std::memory_order_acquire) & ~kClosed) == head) {
+      return std::nullopt;
+    }
+    return pop();
+  }
+
+  // NOTE must be called by the producer.
+  auto close() -> void {
+    tail_.fetch_or(kClosed, std::memory_order_release);
+    tail_.notify_one();
+  }
+
+private:
+  // NOTE the closed flag lives in tail_, so that closing wakes the consumer.
+  static constexpr std::uint64_t kClosed = std::uint64_t(1) << 63;
+
+  std::vector<value_type> slots_;
+  // NOTE head_ is only written by the consumer, tail_ only by the producer.
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_SPSC_RING_H
@@ -0,0 +1,151 @@
+#ifndef UTILS_UNIX_SOCKET_H
+#define UTILS_UNIX_SOCKET_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace wd_migrate::utils {
+namespace detail {
+inline auto unix_address(const std::string &path) -> sockaddr_un {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    std::exit(-1);
+  }
+  path.copy(address.sun_path, path.size());
+  return address;
+}
+} // namespace detail
+
+// Buffered, blocking stream over a connected socket.
+// NOTE the stream owns the file descriptor.
+class socket_stream {
+public:
+  socket_stream(int fd) : fd_(fd) {}
+  socket_stream(socket_stream &&other)
+      : fd_(std::exchange(other.fd_, -1)), buffer_(std::move(other.buffer_)) {}
+  socket_stream(const socket_stream &) = delete;
+  auto operator=(const socket_stream &) -> socket_stream & = delete;
+
+  ~socket_stream() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // NOTE returns std::nullopt if the peer closed the connection before the
+  //      delimiter was received.
+  auto read_until(const std::string_view delimiter)
+      -> std::optional<std::string> {
+    std::uint64_t position;
+    while ((position = buffer_.find(delimiter)) == std::string::npos) {
+      if (!fill()) {
+        return std::nullopt;
+      }
+    }
+    std::string result = buffer_.substr(0, position + delimiter.size());
+    buffer_.erase(0, position + delimiter.size());
+    return result;
+  }
+
+  auto read_exact(std::uint64_t size) -> std::optional<std::string> {
+    while (buffer_.size() < size) {
+      if (!fill()) {
+        return std::nullopt;
+      }
+    }
+    std::string result = buffer_.substr(0, size);
+    buffer_.erase(0, size);
+    return result;
+  }
+
+  auto write_all(const std::string_view data) -> bool {
+    for (std::uint64_t written = 0; written < data.size();) {
+      const ssize_t count = ::send(fd_, data.data() + written,
+                                   data.size() - written, MSG_NOSIGNAL);
+      if (count <= 0) {
+        return false;
+      }
+      written += count;
+    }
+    return true;
+  }
+
+  static auto connect(const std::string &path) -> std::optional<socket_stream> {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const sockaddr_un address = detail::unix_address(path);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                            sizeof(address)) != 0) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      return std::nullopt;
+    }
+    return socket_stream(fd);
+  }
+
+private:
+  auto fill() -> bool {
+    char chunk[1 << 16];
+    const ssize_t count = ::recv(fd_, chunk, sizeof(chunk), 0);
+    if (count <= 0) {
+      return false;
+    }
+    buffer_.append(chunk, count);
+    return true;
+  }
+
+  int fd_;
+  std::string buffer_;
+};
+
+// Listening Unix domain socket.
+// NOTE an existing socket file at path is replaced.
+class unix_listener {
+public:
+  unix_listener(const std::string &path) : path_(path) {
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const sockaddr_un address = detail::unix_address(path);
+    ::unlink(path.c_str());
+    if (fd_ < 0 ||
+        ::bind(fd_, reinterpret_cast<const sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(fd_, SOMAXCONN) != 0) {
+      std::cerr << "Failed to listen on socket: " << path << std::endl;
+      std::exit(-1);
+    }
+  }
+  unix_listener(const unix_listener &) = delete;
+  auto operator=(const unix_listener &) -> unix_listener & = delete;
+
+  ~unix_listener() {
+    ::close(fd_);
+    ::unlink(path_.c_str());
+  }
+
+  auto accept() -> std::optional<socket_stream> {
+    const int fd = ::accept(fd_, nullptr, nullptr);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    return socket_stream(fd);
+  }
+
+private:
+  std::string path_;
+  int fd_;
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_UNIX_SOCKET_H
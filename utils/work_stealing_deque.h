@@ -0,0 +1,81 @@
+#ifndef UTILS_WORK_STEALING_DEQUE_H
+#define UTILS_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace wd_migrate::utils {
+// Bounded Chase-Lev deque: the owning thread pushes and pops at the bottom
+// (LIFO), any other thread steals from the top (FIFO), i.e., thieves take
+// the oldest and typically largest pieces of work.
+// NOTE follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+//      (Lê et al., 2013), without growing the buffer: push fails once the
+//      deque holds capacity values.
+// NOTE value_type should be small and trivially copyable, a thief may read a
+//      slot that the owner pops concurrently (only one of them keeps it).
+template <typename value_type> class work_stealing_deque {
+public:
+  work_stealing_deque(std::uint64_t capacity) : slots_(capacity) {}
+
+  // NOTE must only be called by the owner.
+  auto push(const value_type &value) -> bool {
+    const std::int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const std::int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top >= static_cast<std::int64_t>(slots_.size())) {
+      return false;
+    }
+    slots_[bottom % slots_.size()] = value;
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // NOTE must only be called by the owner.
+  auto pop() -> std::optional<value_type> {
+    const std::int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    const value_type value = slots_[bottom % slots_.size()];
+    if (top == bottom) {
+      // NOTE the last value, race the thieves for it.
+      const bool won = top_.compare_exchange_strong(
+          top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      if (!won) {
+        return std::nullopt;
+      }
+    }
+    return value;
+  }
+
+  auto steal() -> std::optional<value_type> {
+    std::int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return std::nullopt;
+    }
+    const value_type value = slots_[top % slots_.size()];
+    if (!top_.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+private:
+  std::vector<value_type> slots_;
+  alignas(64) std::atomic<std::int64_t> top_{0};
+  alignas(64) std::atomic<std::int64_t> bottom_{0};
+};
+} // namespace wd_migrate::utils
+
+#endif // !UTILS_WORK_STEALING_DEQUE_H
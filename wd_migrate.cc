@@ -1,50 +1,632 @@
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
 #include <ios>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <string_view>
+#include <thread>
 
 #include "fast-cpp-csv-parser/csv.h"
+#include "handler/claim_index_handler.h"
 #include "handler/csv_handler.h"
+#include "handler/diff_handler.h"
 #include "handler/entity_count_handler.h"
+#include "handler/entity_filter_handler.h"
+#include "handler/graph_handler.h"
+#include "handler/rank_filter_handler.h"
+#include "handler/snapshot_handler.h"
+#include "handler/threaded_handler.h"
 #include "handler/wikidata_handler.h"
+#include "parser/snapshot_parser.h"
 #include "parser/wikidata_columns.h"
 #include "parser/wikidata_parser.h"
+#include "query/claims_query.h"
+#include "server/bench_client.h"
+#include "server/claims_store.h"
+#include "server/lookup_server.h"
+#include "utils/bloom_filter.h"
+#include "utils/checkpoint.h"
+#include "utils/mmap_file.h"
+#include "utils/offset_index.h"
+#include "utils/parallel.h"
 #include "utils/progress_indicator.h"
+#include "utils/quarantine.h"
 
 auto print_usage(const std::string_view binary) -> int {
-  std::cerr << "usage: " << binary << " [claims|qualifiers] <filename> <output>"
+  std::cerr << "usage: " << binary
+            << " [claims|qualifiers] <filename> <output> [options]"
+            << std::endl;
+  std::cerr << "       " << binary
+            << " joint <claims> <qualifiers> <claims_output> "
+               "<qualifiers_output> [options]"
+            << std::endl;
+  std::cerr << "       " << binary
+            << " diff <old_claims> <new_claims> <deleted_output> "
+               "<inserted_output> [options]"
+            << std::endl;
+  std::cerr << "       " << binary
+            << " snapshot [claims|qualifiers] <filename> <snapshot>"
+            << std::endl;
+  std::cerr << "       " << binary << " serve <claims_snapshot> <socket>"
+            << std::endl;
+  std::cerr << "       " << binary << " bench <socket> <targets> [connections]"
+            << std::endl;
+  std::cerr << "       " << binary
+            << " query <claims_snapshot> [--property=<P>] [--value=<Q>] "
+               "[--rank=<rank>] [--from=<date>] [--to=<date>] [--print] "
+               "[--threads=<N>]"
+            << std::endl;
+  std::cerr << "       " << binary << " decode-claim-ids < <claim_keys>"
+            << std::endl;
+  std::cerr << "       " << binary << " lookup <output> <index> <entity_id>..."
+            << std::endl;
+  std::cerr << "       " << binary << " contains <filter> <entity_id>..."
+            << std::endl;
+  std::cerr << "options:" << std::endl;
+  std::cerr << "  --rank=[all|non-deprecated|best]  filter claims by rank"
+            << std::endl;
+  std::cerr << "  --claim-id=[text|compact]         output format of claim_ids"
+            << std::endl;
+  std::cerr << "  --time=[text|micros|seconds]      output format of times"
+            << std::endl;
+  std::cerr << "  --sort=[none|subject|object]      sort the claims output"
+            << std::endl;
+  std::cerr << "  --sort-memory=<MiB>               memory budget for sorting"
+            << std::endl;
+  std::cerr << "  --sort-tmp=<prefix>               prefix of sorted runs"
+            << std::endl;
+  std::cerr << "  --graph=<filename>                write the CSR entity graph"
+            << std::endl;
+  std::cerr << "  --index=<filename>                index the entity offsets"
+            << std::endl;
+  std::cerr << "  --entity-filter=<filename>        write entity Bloom filter"
+            << std::endl;
+  std::cerr << "  --checkpoint=<filename>           checkpoint the conversion"
+            << std::endl;
+  std::cerr << "  --checkpoint-interval=<seconds>   time between checkpoints"
+            << std::endl;
+  std::cerr << "  --resume                          resume from the checkpoint"
+            << std::endl;
+  std::cerr << "  --pipeline                        write output on own thread"
+            << std::endl;
+  std::cerr << "  --parse-threads=<N>               parse on N threads"
+            << std::endl;
+  std::cerr << "  --quarantine=<filename>           skip and log malformed rows"
+            << std::endl;
+  std::cerr << "  --max-error-rate=<rate>           abort above this error rate"
             << std::endl;
   return -1;
 }
 
+struct options {
+  wd_migrate::rank_filter_mode rank = wd_migrate::rank_filter_mode::all;
+  wd_migrate::claim_id_format claim_id = wd_migrate::claim_id_format::text;
+  wd_migrate::time_format time = wd_migrate::time_format::text;
+  wd_migrate::csv_sort_options sort;
+  std::string graph;
+  std::string index;
+  std::string entity_filter;
+  wd_migrate::utils::checkpoint_options checkpoint;
+  wd_migrate::utils::quarantine_options quarantine;
+  bool pipeline = false;
+  unsigned parse_threads = 0;
+};
+
+auto option_value(const std::string_view option, const std::string_view name)
+    -> std::optional<std::string_view> {
+  if (option.substr(0, name.size()) != name) {
+    return std::nullopt;
+  }
+  return option.substr(name.size());
+}
+
+auto parse_number(const std::string_view value)
+    -> std::optional<std::uint64_t> {
+  std::uint64_t number;
+  const auto [end, error] =
+      std::from_chars(value.data(), value.data() + value.size(), number);
+  if (error != std::errc() || end != value.data() + value.size()) {
+    return std::nullopt;
+  }
+  return number;
+}
+
+auto parse_options(int argc, char **argv, const std::string_view file_type)
+    -> std::optional<options> {
+  using namespace wd_migrate;
+  options opts;
+  const int first_option =
+      (file_type == "joint" || file_type == "diff" ? 6 : 4);
+  // NOTE sorted output and sidecar files are only written for claims.
+  const bool claims_output = (file_type == "claims" || file_type == "joint");
+  // NOTE checkpoints, pipelining and parse threads are only supported for a
+  //      single input.
+  const bool multiple_inputs = (file_type == "joint" || file_type == "diff");
+  for (int index = first_option; index < argc; ++index) {
+    const std::string_view option(argv[index]);
+    if (const auto rank = option_value(option, "--rank=");
+        rank.has_value() && file_type != "qualifiers") {
+      if (*rank == "all") {
+        opts.rank = rank_filter_mode::all;
+      } else if (*rank == "non-deprecated") {
+        opts.rank = rank_filter_mode::non_deprecated;
+      } else if (*rank == "best") {
+        opts.rank = rank_filter_mode::best_rank;
+      } else {
+        return std::nullopt;
+      }
+    } else if (const auto claim_id = option_value(option, "--claim-id=");
+               claim_id.has_value()) {
+      if (*claim_id == "text") {
+        opts.claim_id = claim_id_format::text;
+      } else if (*claim_id == "compact") {
+        opts.claim_id = claim_id_format::compact;
+      } else {
+        return std::nullopt;
+      }
+    } else if (const auto time = option_value(option, "--time=");
+               time.has_value()) {
+      if (*time == "text") {
+        opts.time = time_format::text;
+      } else if (*time == "micros") {
+        opts.time = time_format::epoch_micros;
+      } else if (*time == "seconds") {
+        opts.time = time_format::epoch_seconds;
+      } else {
+        return std::nullopt;
+      }
+    } else if (const auto sort = option_value(option, "--sort=");
+               sort.has_value() && claims_output) {
+      if (*sort == "none") {
+        opts.sort.order = csv_sort_order::none;
+      } else if (*sort == "subject") {
+        opts.sort.order = csv_sort_order::subject;
+      } else if (*sort == "object") {
+        opts.sort.order = csv_sort_order::object;
+      } else {
+        return std::nullopt;
+      }
+    } else if (const auto memory = option_value(option, "--sort-memory=");
+               memory.has_value()) {
+      const std::optional<std::uint64_t> mebibytes = parse_number(*memory);
+      if (!mebibytes.has_value() || *mebibytes == 0) {
+        return std::nullopt;
+      }
+      opts.sort.memory_budget = *mebibytes << 20;
+    } else if (const auto prefix = option_value(option, "--sort-tmp=");
+               prefix.has_value()) {
+      opts.sort.temp_prefix = *prefix;
+    } else if (const auto graph = option_value(option, "--graph=");
+               graph.has_value() && !graph->empty() &&
+               claims_output) {
+      opts.graph = *graph;
+    } else if (const auto index = option_value(option, "--index=");
+               index.has_value() && !index->empty() &&
+               claims_output) {
+      opts.index = *index;
+    } else if (const auto filter = option_value(option, "--entity-filter=");
+               filter.has_value() && !filter->empty() &&
+               claims_output) {
+      opts.entity_filter = *filter;
+    } else if (const auto checkpoint = option_value(option, "--checkpoint=");
+               checkpoint.has_value() && !checkpoint->empty() &&
+               !multiple_inputs) {
+      opts.checkpoint.filename = *checkpoint;
+    } else if (const auto interval =
+                   option_value(option, "--checkpoint-interval=");
+               interval.has_value()) {
+      const std::optional<std::uint64_t> seconds = parse_number(*interval);
+      if (!seconds.has_value()) {
+        return std::nullopt;
+      }
+      opts.checkpoint.interval = std::chrono::seconds(*seconds);
+    } else if (option == "--pipeline" && !multiple_inputs) {
+      opts.pipeline = true;
+    } else if (const auto threads = option_value(option, "--parse-threads=");
+               threads.has_value() && !multiple_inputs) {
+      const std::optional<std::uint64_t> count = parse_number(*threads);
+      if (!count.has_value() || *count == 0 || *count > 256) {
+        return std::nullopt;
+      }
+      opts.parse_threads = *count;
+    } else if (option == "--resume") {
+      opts.checkpoint.resume = true;
+    } else if (const auto quarantine = option_value(option, "--quarantine=");
+               quarantine.has_value() && !quarantine->empty()) {
+      opts.quarantine.filename = *quarantine;
+    } else if (const auto rate = option_value(option, "--max-error-rate=");
+               rate.has_value()) {
+      double max_error_rate;
+      const auto [end, error] = std::from_chars(
+          rate->data(), rate->data() + rate->size(), max_error_rate);
+      if (error != std::errc() || end != rate->data() + rate->size() ||
+          max_error_rate < 0 || max_error_rate > 1) {
+        return std::nullopt;
+      }
+      opts.quarantine.max_error_rate = max_error_rate;
+    } else {
+      return std::nullopt;
+    }
+  }
+  // NOTE sorted runs are not part of the checkpoint.
+  if (opts.checkpoint.resume && opts.checkpoint.filename.empty()) {
+    return std::nullopt;
+  }
+  if (!opts.checkpoint.filename.empty() &&
+      opts.sort.order != csv_sort_order::none) {
+    return std::nullopt;
+  }
+  // NOTE parallel parsing hands rows to the handlers in chunks, which are not
+  //      aligned to checkpoints.
+  if (!opts.checkpoint.filename.empty() && opts.parse_threads > 0) {
+    return std::nullopt;
+  }
+  return opts;
+}
+
+// NOTE if pipelined, the output handler runs on its own thread.
+template <bool pipelined, typename handler_type>
+auto maybe_threaded(handler_type &&handler) {
+  if constexpr (pipelined) {
+    return wd_migrate::threaded_handler(std::move(handler));
+  } else {
+    return std::move(handler);
+  }
+}
+
+// NOTE if index is set, the claims written to the output are assigned ids in
+//      it, and entities are marked as done once the rank filter has flushed
+//      them (which requires writing the output on the parsing thread).
+template <bool pipelined = false>
+auto make_claims_handler(const options &opts, const std::string &output,
+                         wd_migrate::claim_index *index = nullptr) {
+  using namespace wd_migrate;
+  return stacked_handler(
+      stats_handler</*print_illegal_values=*/false>(),
+      quantity_scale_handler(),
+      rank_filter_handler(
+          opts.rank,
+          stacked_handler(entity_count_handler(),
+                          entity_filter_handler(opts.entity_filter),
+                          graph_handler(opts.graph),
+                          maybe_threaded<pipelined>(
+                              csv_handler<claims_tag_t, /*psql=*/false>(
+                                  output,
+                                  claim_id_encoder{.format = opts.claim_id,
+                                                   .index = index,
+                                                   .assign_ids = true},
+                                  opts.time, opts.sort, opts.index,
+                                  opts.checkpoint.resume)))),
+      claim_index_handler(index));
+}
+
+template <bool pipelined = false>
+auto make_qualifiers_handler(const options &opts, const std::string &output,
+                             wd_migrate::claim_index *index = nullptr) {
+  using namespace wd_migrate;
+  return stacked_handler(stats_handler</*print_illegal_values=*/false>(),
+                         quantity_scale_handler(),
+                         maybe_threaded<pipelined>(
+                             csv_handler<qualifiers_tag_t, /*psql=*/false>(
+                                 output,
+                                 claim_id_encoder{.format = opts.claim_id,
+                                                  .index = index},
+                                 opts.time, /*sort=*/{}, /*index=*/{},
+                                 opts.checkpoint.resume)));
+}
+
+// NOTE filename is either a TSV dump or a snapshot of it.
+// NOTE the checkpoint is removed once the conversion is complete.
 template <typename tag, typename result_handler>
-auto parse_wikidata(const std::string_view filename, result_handler &handler)
-    -> void {
-  wd_migrate::wikidata_parser<tag, result_handler> parser;
-  parser.parse(std::string(filename), &handler);
+auto parse_wikidata(const std::string_view filename, result_handler &handler,
+                    const wd_migrate::utils::checkpoint_options &checkpoint =
+                        {},
+                    const wd_migrate::utils::quarantine_options &quarantine =
+                        {},
+                    unsigned parse_threads = 0) -> void {
+  wd_migrate::wikidata_input_parser<tag, result_handler> parser;
+  parser.parse(std::string(filename), &handler, checkpoint, quarantine,
+               parse_threads);
   handler.summary();
+  parser.summary();
+  if (!checkpoint.filename.empty()) {
+    std::filesystem::remove(checkpoint.filename);
+  }
 }
 
-auto main(int argc, char **argv) -> int {
+// NOTE inputs converted concurrently each get their own quarantine file.
+auto with_suffix(wd_migrate::utils::quarantine_options quarantine,
+                 const std::string_view suffix)
+    -> wd_migrate::utils::quarantine_options {
+  if (!quarantine.filename.empty()) {
+    quarantine.filename += suffix;
+  }
+  return quarantine;
+}
+
+template <bool pipelined>
+auto convert(const std::string_view file_type, const options &opts,
+             char **argv) -> void {
   using namespace wd_migrate;
-  if (argc <= 3) {
+  if (file_type == "claims") {
+    auto handler = make_claims_handler<pipelined>(opts, argv[3]);
+    parse_wikidata<claims_tag_t>(argv[2], handler, opts.checkpoint,
+                                 opts.quarantine, opts.parse_threads);
+  } else {
+    auto handler = make_qualifiers_handler<pipelined>(opts, argv[3]);
+    parse_wikidata<qualifiers_tag_t>(argv[2], handler, opts.checkpoint,
+                                     opts.quarantine, opts.parse_threads);
+  }
+}
+
+// Converts claims and qualifiers concurrently. Claims are assigned dense
+// integer ids, which the qualifiers reference instead of the claim_id.
+auto parse_wikidata_joint(const options &opts, char **argv) -> void {
+  using namespace wd_migrate;
+  claim_index index;
+  auto claims_handler = make_claims_handler(opts, argv[4], &index);
+  auto qualifiers_handler = make_qualifiers_handler(opts, argv[5], &index);
+  wikidata_input_parser<claims_tag_t, decltype(claims_handler)> claims_parser;
+  wikidata_input_parser<qualifiers_tag_t, decltype(qualifiers_handler)>
+      qualifiers_parser;
+
+  std::thread claims_thread([&]() {
+    claims_parser.parse(argv[2], &claims_handler, {},
+                        with_suffix(opts.quarantine, ".claims"));
+    index.done();
+  });
+  qualifiers_parser.parse(argv[3], &qualifiers_handler, {},
+                          with_suffix(opts.quarantine, ".qualifiers"));
+  claims_thread.join();
+
+  std::cout << "claims:" << std::endl;
+  claims_handler.summary();
+  claims_parser.summary();
+  std::cout << "qualifiers:" << std::endl;
+  qualifiers_handler.summary();
+  qualifiers_parser.summary();
+}
+
+// Converts two claims dumps concurrently and writes the output rows that
+// have to be deleted from and inserted into the old conversion to obtain the
+// new one.
+auto parse_wikidata_diff(const options &opts, char **argv) -> void {
+  using namespace wd_migrate;
+  // NOTE bounds the number of converted entities in flight per dump.
+  static constexpr std::uint64_t kQueueCapacity = 1024;
+  utils::bounded_queue<entity_group> old_groups(kQueueCapacity),
+      new_groups(kQueueCapacity);
+  std::ostringstream old_rows, new_rows;
+  const auto make_handler = [&](std::ostringstream &rows,
+                                utils::bounded_queue<entity_group> &groups) {
+    return rank_filter_handler(
+        opts.rank,
+        stacked_handler(csv_handler<claims_tag_t, /*psql=*/false>(
+                            rows, claim_id_encoder{.format = opts.claim_id},
+                            opts.time),
+                        entity_group_handler(rows, groups)));
+  };
+  auto old_handler = make_handler(old_rows, old_groups);
+  auto new_handler = make_handler(new_rows, new_groups);
+  wikidata_input_parser<claims_tag_t, decltype(old_handler)> old_parser;
+  wikidata_input_parser<claims_tag_t, decltype(new_handler)> new_parser;
+
+  std::thread old_thread([&]() {
+    old_parser.parse(argv[2], &old_handler, {},
+                     with_suffix(opts.quarantine, ".old"));
+    old_groups.close();
+  });
+  std::thread new_thread([&]() {
+    new_parser.parse(argv[3], &new_handler, {},
+                     with_suffix(opts.quarantine, ".new"));
+    new_groups.close();
+  });
+  entity_group_diff diff(argv[4], argv[5]);
+  diff.run(old_groups, new_groups);
+  old_thread.join();
+  new_thread.join();
+
+  std::cout << "old:" << std::endl;
+  old_handler.summary();
+  old_parser.summary();
+  std::cout << "new:" << std::endl;
+  new_handler.summary();
+  new_parser.summary();
+  diff.summary();
+}
+
+// Parses the dump once into a snapshot, which all other modes accept as input
+// instead of the dump.
+template <typename tag>
+auto write_snapshot(const std::string_view filename,
+                    const std::string &snapshot) -> void {
+  using namespace wd_migrate;
+  auto handler =
+      stacked_handler(stats_handler</*print_illegal_values=*/false>(),
+                      snapshot_handler<tag>(snapshot));
+  parse_wikidata<tag>(filename, handler);
+}
+
+// Serves entity and (property, value) lookups over a claims snapshot.
+auto serve_snapshot(const std::string &snapshot, const std::string &socket)
+    -> void {
+  using namespace wd_migrate;
+  const server::claims_store store(snapshot);
+  server::lookup_server(store).serve(socket);
+}
+
+// Replays the request targets (one per line) against a running server.
+auto run_benchmark(int argc, char **argv) -> int {
+  using namespace wd_migrate;
+  std::optional<std::uint64_t> connections = 1;
+  if (argc > 4) {
+    connections = parse_number(argv[4]);
+  }
+  std::ifstream input(argv[3]);
+  if (!input || !connections.has_value()) {
     return print_usage(argv[0]);
   }
+  std::vector<std::string> targets;
+  for (std::string line; std::getline(input, line);) {
+    if (!line.empty()) {
+      targets.push_back(line);
+    }
+  }
+  server::bench_client(argv[2], *connections).run(targets);
+  return 0;
+}
+
+// Counts (or prints) the claims of a snapshot matching all given predicates.
+auto query_snapshot(int argc, char **argv) -> int {
+  using namespace wd_migrate;
+  query::claims_predicate predicate;
+  bool print = false;
+  std::optional<std::uint64_t> thread_count = utils::default_thread_count();
+  for (int index = 3; index < argc; ++index) {
+    const std::string_view option(argv[index]);
+    if (const auto property = option_value(option, "--property=")) {
+      predicate.property = *property;
+    } else if (const auto value = option_value(option, "--value=")) {
+      predicate.value = *value;
+    } else if (const auto rank = option_value(option, "--rank=")) {
+      predicate.rank = *rank;
+    } else if (const auto from = option_value(option, "--from=")) {
+      predicate.from = query::parse_date(*from);
+      if (!predicate.from.has_value()) {
+        return print_usage(argv[0]);
+      }
+    } else if (const auto to = option_value(option, "--to=")) {
+      predicate.to = query::parse_date(*to);
+      if (!predicate.to.has_value()) {
+        return print_usage(argv[0]);
+      }
+    } else if (const auto threads = option_value(option, "--threads=")) {
+      thread_count = parse_number(*threads);
+      if (!thread_count.has_value() || *thread_count == 0) {
+        return print_usage(argv[0]);
+      }
+    } else if (option == "--print") {
+      print = true;
+    } else {
+      return print_usage(argv[0]);
+    }
+  }
+  const query::claims_query query(argv[2]);
+  if (print) {
+    query.print(predicate, *thread_count, std::cout);
+  } else {
+    std::cout << query.count(predicate, *thread_count) << std::endl;
+  }
+  return 0;
+}
+
+// Maps compact claim keys (one per line) back to the original claim_ids.
+// NOTE lines that are not compact claim keys are copied as-is.
+auto decode_claim_ids() -> void {
+  using namespace wd_migrate;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    const std::optional<wd_claim_key_t> key = claim_key_from_hex(line);
+    std::cout << (key.has_value() ? claim_key_to_string(*key) : line) << '\n';
+  }
+}
+
+// Prints the rows of the given entities using the sidecar offset index.
+auto lookup_entities(int argc, char **argv) -> int {
+  using namespace wd_migrate;
+  const utils::mmap_file output(argv[2]);
+  const utils::offset_index_view index(argv[3]);
+  for (int arg = 4; arg < argc; ++arg) {
+    const std::optional<std::uint64_t> entity_id = encode_entity_id(argv[arg]);
+    if (!entity_id.has_value()) {
+      std::cerr << "Invalid entity id: " << argv[arg] << std::endl;
+      return -1;
+    }
+    for (const utils::offset_index_entry &entry : index.find(*entity_id)) {
+      const char *begin = output.data() + entry.offset, *end = begin;
+      const char *const eof = output.data() + output.size();
+      for (std::uint64_t row = 0; row < entry.row_count && end < eof; ++row) {
+        const void *newline = std::memchr(end, '\n', eof - end);
+        end = (newline != nullptr ? static_cast<const char *>(newline) + 1
+                                  : eof);
+      }
+      std::cout.write(begin, end - begin);
+    }
+  }
+  return 0;
+}
+
+// Prints whether the given entities may be part of the output.
+// NOTE the filter has false positives, but no false negatives.
+auto probe_entities(int argc, char **argv) -> int {
+  using namespace wd_migrate;
+  const utils::bloom_filter_view filter(argv[2]);
+  for (int arg = 3; arg < argc; ++arg) {
+    const std::optional<std::uint64_t> entity_id = encode_entity_id(argv[arg]);
+    const bool contained =
+        entity_id.has_value() && filter.contains(*entity_id);
+    std::cout << argv[arg] << '\t' << contained << '\n';
+  }
+  return 0;
+}
+
+auto main(int argc, char **argv) -> int {
+  using namespace wd_migrate;
   std::ios_base::sync_with_stdio(false);
   std::cin.tie(nullptr);
+  if (argc == 2 && std::string_view(argv[1]) == "decode-claim-ids") {
+    decode_claim_ids();
+    return 0;
+  }
+  if (argc > 4 && std::string_view(argv[1]) == "lookup") {
+    return lookup_entities(argc, argv);
+  }
+  if (argc > 3 && std::string_view(argv[1]) == "contains") {
+    return probe_entities(argc, argv);
+  }
+  if (argc >= 3 && std::string_view(argv[1]) == "query") {
+    return query_snapshot(argc, argv);
+  }
+  if (argc <= 3) {
+    return print_usage(argv[0]);
+  }
+  if (argc == 4 && std::string_view(argv[1]) == "serve") {
+    serve_snapshot(argv[2], argv[3]);
+    return 0;
+  }
+  if (argc >= 4 && argc <= 5 && std::string_view(argv[1]) == "bench") {
+    return run_benchmark(argc, argv);
+  }
+  if (argc == 5 && std::string_view(argv[1]) == "snapshot") {
+    const std::string_view file_type(argv[2]);
+    if (file_type == "claims") {
+      write_snapshot<claims_tag_t>(argv[3], argv[4]);
+    } else if (file_type == "qualifiers") {
+      write_snapshot<qualifiers_tag_t>(argv[3], argv[4]);
+    } else {
+      return print_usage(argv[0]);
+    }
+    return 0;
+  }
 
   std::string_view file_type(argv[1]);
-  if (file_type == "claims") {
-    auto handler =
-        stacked_handler(stats_handler</*print_illegal_values=*/false>(),
-                        quantity_scale_handler(), entity_count_handler(),
-                        csv_handler<claims_tag_t, /*psql=*/false>(argv[3]));
-    parse_wikidata<claims_tag_t>(argv[2], handler);
-  } else if (file_type == "qualifiers") {
-    auto handler =
-        stacked_handler(stats_handler</*print_illegal_values=*/false>(),
-                        quantity_scale_handler(),
-                        csv_handler<qualifiers_tag_t, /*psql=*/false>(argv[3]));
-    parse_wikidata<qualifiers_tag_t>(argv[2], handler);
+  const std::optional<options> opts = parse_options(argc, argv, file_type);
+  if (!opts.has_value()) {
+    return print_usage(argv[0]);
+  }
+  if ((file_type == "claims" || file_type == "qualifiers") &&
+      opts->pipeline) {
+    convert<true>(file_type, *opts, argv);
+  } else if (file_type == "claims" || file_type == "qualifiers") {
+    convert<false>(file_type, *opts, argv);
+  } else if (file_type == "joint" && argc > 5) {
+    parse_wikidata_joint(*opts, argv);
+  } else if (file_type == "diff" && argc > 5) {
+    parse_wikidata_diff(*opts, argv);
   } else {
     return print_usage(argv[0]);
   }